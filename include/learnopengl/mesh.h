@@ -7,6 +7,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/Meshlets.h>
+#include <rg/ShaderPermutations.h>
+#include <rg/TextureUnits.h>
 
 #include <string>
 #include <vector>
@@ -19,83 +23,236 @@ struct Vertex {
     glm::vec3 Normal;
     // texCoords
     glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
 };
 
 
 
+// what a material texture is used for, its sampler is named <prefix><role name>N (material.texture_diffuse1, ...)
+enum class TextureRole : unsigned char {
+    Diffuse,
+    Specular,
+    Normal,
+    Height,
+    Count
+};
+
+inline const char* TextureRoleName(TextureRole role)
+{
+    switch (role)
+    {
+        case TextureRole::Diffuse: return "texture_diffuse";
+        case TextureRole::Specular: return "texture_specular";
+        case TextureRole::Normal: return "texture_normal";
+        case TextureRole::Height: return "texture_height";
+        default: return "";
+    }
+}
+
 struct Texture {
     unsigned int id;
-    string type;
+    TextureRole role;
     string path;
 };
 
+// texture unit of the N-th (1 based) texture of a role, every role owns rg::kMaterialTexturesPerRole units
+inline GLuint MaterialTextureUnit(TextureRole role, unsigned int number)
+{
+    return (GLuint)role * rg::kMaterialTexturesPerRole + (number - 1);
+}
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    // only filled for meshes with a normal map: xyz tangent, w handedness, bitangent = cross(Normal, tangent.xyz) * w
+    vector<glm::vec4>    tangents;
 
     unsigned int VAO;
+    // positions only (attribute 0, 12 bytes per vertex) with the same indices, for depth and shadow programs. 0 if the
+    // mesh has none, then those programs use VAO like every other program
+    unsigned int depthVAO = 0;
+    // true if attribute 3 of the VAO holds tangents
+    bool hasTangents = false;
+    // blended material, drawn after the opaque meshes and back to front
+    bool transparent = false;
+    // model space bounds for culling, empty if unknown (such meshes are never culled)
+    rg::Aabb bounds;
+    rg::Sphere sphere;
+    // triangle clusters of large meshes, culled one by one before drawing; empty if the mesh is drawn whole
+    vector<rg::Meshlet> meshlets;
+    // prefix of the sampler names, clear materialBindings after changing it
     std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // per program texture unit -> texture table, resolved on the first Draw with that program
+    struct TextureBinding {
+        GLuint unit;
+        GLuint texture;
+    };
+    struct MaterialBindings {
+        GLuint program;
+        vector<TextureBinding> bindings;
+    };
+    vector<MaterialBindings> materialBindings;
+    // index range drawn by Draw, the element buffer bound to the VAO holds indexCount indices of indexType starting at indexOffset bytes,
+    // added to baseVertex. Meshes sharing a VAO (see Model::packGeometry) differ only in these.
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t indexOffset = 0;
+    GLint baseVertex = 0;
+    // constructor; without createBuffers the owner puts the geometry into shared buffers and fills in the VAOs and range
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, vector<glm::vec4> tangents = vector<glm::vec4>(),
+         bool createBuffers = true)
+        : VAO(0), VBO(0), EBO(0)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->tangents = tangents;
+        this->indexCount = (GLsizei)this->indices.size();
+        this->hasTangents = !this->tangents.empty();
+        for (const Vertex &vertex : this->vertices)
+            bounds.add(vertex.Position);
+        sphere = rg::boundingSphere(bounds);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (createBuffers)
+            setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // constructor for meshes whose buffers were uploaded by the loader (e.g. glTF buffer views), no CPU copy is kept
+    Mesh(unsigned int VAO, GLsizei indexCount, GLenum indexType, size_t indexOffset, vector<Texture> textures)
+        : VAO(VAO), indexCount(indexCount), indexType(indexType), indexOffset(indexOffset), VBO(0), EBO(0), tangentVBO(0)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        this->textures = textures;
+    }
+
+    bool HasTexture(TextureRole role) const
+    {
+        for (const Texture &texture : textures)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            if (texture.role == role)
+                return true;
         }
+        return false;
+    }
 
+    // shader features this mesh's material needs, see rg::ShaderPermutations
+    uint32_t MaterialFeatures() const
+    {
+        return rg::materialFeatures(HasTexture(TextureRole::Specular), hasTangents && HasTexture(TextureRole::Normal));
+    }
 
+    // identifies the texture set for draw sorting, meshes with the same textures get the same id
+    uint32_t MaterialId() const
+    {
+        uint64_t hash = rg::kFnvOffset;
+        for (const Texture &texture : textures)
+            hash = rg::fnv1a((const char*)&texture.id, sizeof(texture.id), hash);
+        return (uint32_t)(hash ^ (hash >> 32));
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // true if both meshes bind the same textures in the same roles
+    bool SameMaterial(const Mesh &other) const
+    {
+        if (textures.size() != other.textures.size())
+            return false;
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            if (textures[i].id != other.textures[i].id || textures[i].role != other.textures[i].role)
+                return false;
+        }
+        return true;
+    }
+
+    // the VAO this program reads from, the position only one for depth programs
+    GLuint VertexArrayFor(const Shader &shader) const
+    {
+        return depthVAO && shader.readsPositionOnly() ? depthVAO : VAO;
+    }
+
+    // bind the material textures the program samples, skipping units that already hold the right texture
+    void BindMaterial(Shader &shader)
+    {
+        for (const TextureBinding &binding : MaterialBindingsFor(shader))
+            rg::TextureUnits::bind2D(binding.unit, binding.texture);
+    }
+
+    size_t IndexSize() const
+    {
+        return indexType == GL_UNSIGNED_BYTE ? 1 : indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    }
+
+    // render the mesh
+    void Draw(Shader &shader)
+    {
+        DrawRange(shader, 0, indexCount);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // render count indices of the mesh starting at first (both counted in indices, from the start of the mesh's
+    // range), e.g. the meshlets that survived culling
+    void DrawRange(Shader &shader, GLuint first, GLsizei count)
+    {
+        BindMaterial(shader);
+
+        // draw mesh, the VAO stays bound so the next draw with the same mesh skips the bind
+        rg::GLState::bindVertexArray(VertexArrayFor(shader));
+        glDrawElementsBaseVertex(GL_TRIANGLES, count, indexType, (void*)(indexOffset + first * IndexSize()), baseVertex);
+    }
+
+    // render count instances, the VAO must have the per instance attributes set up (see Model::DrawInstanced)
+    void DrawInstanced(Shader &shader, GLsizei count)
+    {
+        BindMaterial(shader);
+        rg::GLState::bindVertexArray(VertexArrayFor(shader));
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, count, baseVertex);
     }
 
 private:
+    // finds or builds the binding table for this program. Building it also points the program's sampler uniforms
+    // at their fixed units; samplers the mesh has no texture for get texture 0, so they never read another
+    // mesh's leftovers.
+    const vector<TextureBinding>& MaterialBindingsFor(Shader &shader)
+    {
+        for (const MaterialBindings &entry : materialBindings)
+        {
+            if (entry.program == shader.ID)
+                return entry.bindings;
+        }
+        MaterialBindings entry;
+        entry.program = shader.ID;
+        for (unsigned int role = 0; role < (unsigned int)TextureRole::Count; role++)
+        {
+            unsigned int number = 0;
+            for (const Texture &texture : textures)
+            {
+                if (texture.role != (TextureRole)role || ++number > rg::kMaterialTexturesPerRole)
+                    continue;
+                GLint location = shader.location(glslIdentifierPrefix + TextureRoleName(texture.role) + std::to_string(number));
+                if (location < 0)
+                    continue;
+                GLuint unit = MaterialTextureUnit(texture.role, number);
+                shader.setInt(location, (int)unit);
+                entry.bindings.push_back({unit, texture.id});
+            }
+            for (unsigned int missing = number + 1; missing <= rg::kMaterialTexturesPerRole; missing++)
+            {
+                GLint location = shader.location(glslIdentifierPrefix + TextureRoleName((TextureRole)role) + std::to_string(missing));
+                if (location < 0)
+                    continue;
+                GLuint unit = MaterialTextureUnit((TextureRole)role, missing);
+                shader.setInt(location, (int)unit);
+                entry.bindings.push_back({unit, 0});
+            }
+        }
+        materialBindings.push_back(entry);
+        return materialBindings.back().bindings;
+    }
+
     // render data
     unsigned int VBO, EBO;
+    unsigned int tangentVBO = 0;
+    unsigned int positionVBO = 0;
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -126,12 +283,29 @@ private:
         // vertex texture coords
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // vertex tangent, a separate stream that exists only for normal mapped meshes
+        if (hasTangents)
+        {
+            glGenBuffers(1, &tangentVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, tangentVBO);
+            glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec4), &tangents[0], GL_STATIC_DRAW);
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        }
+
+        // the depth stream repeats the positions tightly packed, so depth passes fetch 12 instead of sizeof(Vertex)
+        // bytes per vertex; it shares the element buffer
+        vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
 
         glBindVertexArray(0);
     }
@@ -12,7 +12,13 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <rg/AssimpResourceIO.h>
+#include <rg/Gltf.h>
+#include <rg/TangentSpace.h>
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -21,7 +27,22 @@
 #include <vector>
 using namespace std;
 
+// stb_image pixels, decoded on any thread and uploaded by TextureFromImage on the GL thread
+struct DecodedImage {
+    std::shared_ptr<unsigned char> pixels;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+
+    // what the texture takes on the GPU, mip chain included
+    size_t textureBytes() const { return (size_t)width * height * components * 4 / 3; }
+};
+
+bool DecodeImage(const unsigned char *buffer, size_t length, DecodedImage &image, bool flip = true);
+bool DecodeImageFile(const char *path, const string &directory, DecodedImage &image);
+unsigned int TextureFromImage(const DecodedImage &image);
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromMemory(const unsigned char *buffer, size_t length, bool gamma = false);
 
 
 
@@ -38,6 +59,90 @@ public:
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
     {
         loadModel(path);
+        setupInstanceAttributes();
+    }
+
+    // empty model, draws nothing; what Decode fills and Release leaves behind
+    Model() : gammaCorrection(false)
+    {
+    }
+
+    // reads the model without touching GL, so it can run on a worker thread: meshes and decoded textures wait in
+    // memory until Upload() is called on the GL thread. Binary glTF goes to the GPU straight from its mapped file
+    // and is only read by Upload().
+    static Model Decode(string const &path, bool gamma = false)
+    {
+        Model model;
+        model.gammaCorrection = gamma;
+        model.deferred = true;
+        model.loadModel(path);
+        return model;
+    }
+
+    // the GL half of Decode: creates the textures and buffers. Binds GL objects directly, see rg::GLState.
+    void Upload()
+    {
+        if(!deferred)
+            return;
+        deferred = false;
+        if(!pendingPath.empty())
+        {
+            string path;
+            path.swap(pendingPath);
+            loadModel(path);
+        }
+        for(PendingImage &pending : pendingImages)
+        {
+            unsigned int id = TextureFromImage(pending.image);
+            for(Texture &texture : textures_loaded)
+            {
+                if(texture.path == pending.path)
+                    texture.id = id;
+            }
+            for(Mesh &mesh : meshes)
+            {
+                for(Texture &texture : mesh.textures)
+                {
+                    if(texture.path == pending.path)
+                        texture.id = id;
+                }
+            }
+        }
+        pendingImages.clear();
+        packGeometry();
+        setupInstanceAttributes();
+    }
+
+    // deletes the textures, buffers and vertex arrays of the model and empties it. Copies share these objects and
+    // must not be drawn afterwards.
+    void Release()
+    {
+        for(const Texture &texture : textures_loaded)
+            glDeleteTextures(1, &texture.id);
+        vector<unsigned int> vertexArrays;
+        for(const Mesh &mesh : meshes)
+        {
+            const unsigned int arrays[] = {mesh.VAO, mesh.depthVAO};
+            for(unsigned int vertexArray : arrays)
+            {
+                if(vertexArray && std::find(vertexArrays.begin(), vertexArrays.end(), vertexArray) == vertexArrays.end())
+                    vertexArrays.push_back(vertexArray);
+            }
+        }
+        if(!vertexArrays.empty())
+            glDeleteVertexArrays((GLsizei)vertexArrays.size(), vertexArrays.data());
+        if(!buffers.empty())
+            glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
+        if(instanceBuffer)
+            glDeleteBuffers(1, &instanceBuffer);
+        *this = Model();
+    }
+
+    // bytes the model holds: its GPU buffers and textures and the vertex data kept on the CPU. Before Upload the
+    // geometry is only counted once and binary glTF not at all.
+    size_t MemoryBytes() const
+    {
+        return memoryBytes;
     }
 
     // draws the model, and thus all its meshes
@@ -47,18 +152,110 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // draws count copies of the model in one draw per mesh, one copy per transform. The program has to be built with
+    // INSTANCED, it then reads the transform from attributes 4-7 instead of the "model" uniform.
+    void DrawInstanced(Shader &shader, const glm::mat4 *transforms, GLsizei count)
+    {
+        if(count <= 0)
+            return;
+        uploadInstances(transforms, count);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, count);
+    }
+
+    // same with the lighting variant each mesh's material needs
+    void DrawInstanced(rg::ShaderPermutations &variants, uint32_t frameFeatures, const glm::mat4 *transforms, GLsizei count)
+    {
+        if(count <= 0)
+            return;
+        uploadInstances(transforms, count);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Shader *variant;
+            variants.use(frameFeatures | rg::FeatureInstanced | meshes[i].MaterialFeatures(), variant);
+            meshes[i].DrawInstanced(*variant, count);
+        }
+    }
+
+    // buffer the instance attributes read from, see rg::GpuCulling
+    unsigned int InstanceBuffer() const
+    {
+        return instanceBuffer;
+    }
+
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
+            mesh.materialBindings.clear();
         }
     }
 private:
+    // per instance transforms of DrawInstanced, respecified on every call. Created with the model, so copies share it
+    // along with the VAOs that point at it.
+    unsigned int instanceBuffer = 0;
+    // GL buffers holding the geometry, deleted by Release
+    vector<unsigned int> buffers;
+    size_t memoryBytes = 0;
+
+    // state of a model from Decode until Upload
+    struct PendingImage {
+        string path; // as in textures_loaded
+        DecodedImage image;
+    };
+    bool deferred = false;
+    string pendingPath; // binary glTF, read by Upload
+    vector<PendingImage> pendingImages;
+
+    void setupInstanceAttributes()
+    {
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        // a mat4 attribute is four vec4 columns, each advancing once per instance. Meshes may share VAOs
+        // (packGeometry), setting one up twice does no harm.
+        for(const Mesh &mesh : meshes)
+        {
+            const unsigned int arrays[] = {mesh.VAO, mesh.depthVAO};
+            for(unsigned int vertexArray : arrays)
+            {
+                if(!vertexArray)
+                    continue;
+                glBindVertexArray(vertexArray);
+                for(GLuint column = 0; column < 4; column++)
+                {
+                    GLuint location = Shader::kInstanceAttribute + column;
+                    glEnableVertexAttribArray(location);
+                    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+                    glVertexAttribDivisor(location, 1);
+                }
+            }
+        }
+        glBindVertexArray(0);
+    }
+
+    void uploadInstances(const glm::mat4 *transforms, GLsizei count)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        // orphan the old storage, draws still reading it keep their copy
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), transforms, GL_STREAM_DRAW);
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
-        // read file via ASSIMP
+        // binary glTF is read natively, its buffers can go to the GPU as they are
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".glb") == 0)
+        {
+            directory = path.substr(0, path.find_last_of('/'));
+            if(deferred)
+                pendingPath = path;
+            else
+                loadBinaryGltf(path);
+            return;
+        }
+        // read file via ASSIMP, the model and the files it references go through rg::Resources
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        importer.SetIOHandler(new rg::ResourceIOSystem);
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
@@ -70,6 +267,92 @@ private:
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        if(!deferred)
+            packGeometry();
+    }
+
+    // uploads the geometry of all meshes into one set of buffers: interleaved vertices, the packed positions of the depth
+    // VAO, tangents if any mesh has them (zeros for the others, which never read them) and the indices, which stay relative
+    // to each mesh's baseVertex. The meshes then differ only in their index range, so draws of one model can be merged
+    // into a multi-draw (see rg::RenderQueue).
+    void packGeometry()
+    {
+        size_t vertexCount = 0, indexCount = 0;
+        bool anyTangents = false;
+        for(const Mesh &mesh : meshes)
+        {
+            vertexCount += mesh.vertices.size();
+            indexCount += mesh.indices.size();
+            anyTangents = anyTangents || mesh.hasTangents;
+        }
+        if(vertexCount == 0 || indexCount == 0)
+            return;
+
+        vector<Vertex> vertices;
+        vector<glm::vec3> positions;
+        vector<glm::vec4> tangents;
+        vector<unsigned int> indices;
+        vertices.reserve(vertexCount);
+        positions.reserve(vertexCount);
+        tangents.reserve(anyTangents ? vertexCount : 0);
+        indices.reserve(indexCount);
+        for(Mesh &mesh : meshes)
+        {
+            mesh.baseVertex = (GLint)vertices.size();
+            mesh.indexOffset = indices.size() * sizeof(unsigned int);
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            for(const Vertex &vertex : mesh.vertices)
+                positions.push_back(vertex.Position);
+            if(anyTangents && mesh.hasTangents)
+                tangents.insert(tangents.end(), mesh.tangents.begin(), mesh.tangents.end());
+            else if(anyTangents)
+                tangents.resize(tangents.size() + mesh.vertices.size(), glm::vec4(0.0f));
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+
+        unsigned int buffers[4] = {0, 0, 0, 0};
+        glGenBuffers(anyTangents ? 4 : 3, buffers);
+        this->buffers.insert(this->buffers.end(), buffers, buffers + (anyTangents ? 4 : 3));
+        // the GPU copy, processMesh counted the one the meshes keep on the CPU
+        memoryBytes += vertices.size() * sizeof(Vertex) + tangents.size() * sizeof(glm::vec4) +
+                       indices.size() * sizeof(unsigned int) + positions.size() * sizeof(glm::vec3);
+        unsigned int VAO, depthVAO;
+        glGenVertexArrays(1, &VAO);
+        glGenVertexArrays(1, &depthVAO);
+
+        // same attribute locations as Mesh::setupMesh
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        if(anyTangents)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[3]);
+            glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec4), tangents.data(), GL_STATIC_DRAW);
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[2]);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+        glBindVertexArray(0);
+
+        for(Mesh &mesh : meshes)
+        {
+            mesh.VAO = VAO;
+            mesh.depthVAO = depthVAO;
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -125,16 +408,6 @@ private:
                 vec.x = mesh->mTextureCoords[0][i].x;
                 vec.y = mesh->mTextureCoords[0][i].y;
                 vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
@@ -164,27 +437,361 @@ private:
 
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, TextureRole::Diffuse);
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, TextureRole::Specular);
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, TextureRole::Normal);
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, TextureRole::Height);
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
+        // tangents are only needed to sample a normal map, everything else goes without the tangent stream
+        vector<glm::vec4> tangents;
+        if(!normalMaps.empty() && mesh->mTextureCoords[0] && mesh->HasNormals() && !vertices.empty())
+        {
+            rg::TangentInput input = {
+                    (const unsigned char*)&vertices[0].Position, sizeof(Vertex),
+                    (const unsigned char*)&vertices[0].Normal, sizeof(Vertex),
+                    (const unsigned char*)&vertices[0].TexCoords, sizeof(Vertex),
+                    vertices.size()
+            };
+            vector<unsigned int> splitSources;
+            tangents = rg::generateTangents(input, indices, true, &splitSources);
+            for(unsigned int source : splitSources)
+                vertices.push_back(vertices[source]);
+        }
+
+        float opacity = 1.0f;
+        material->Get(AI_MATKEY_OPACITY, opacity);
 
+        // large meshes are split into meshlets, which puts each cluster's triangles next to each other in indices
+        vector<glm::vec3> positions(vertices.size());
+        for(size_t i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+        vector<rg::Meshlet> meshlets = rg::buildMeshlets(positions, indices);
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        memoryBytes += vertices.size() * sizeof(Vertex) + tangents.size() * sizeof(glm::vec4) +
+                       indices.size() * sizeof(unsigned int);
+        Mesh result(vertices, indices, textures, tangents, false); // uploaded by packGeometry
+        result.transparent = opacity < 1.0f;
+        result.meshlets.swap(meshlets);
+        return result;
+    }
+
+    // loads a binary glTF file. The geometry buffer views are uploaded straight from the mapped file and the accessors
+    // are described to the VAO as they are stored, so there is no per-vertex conversion on the CPU.
+    void loadBinaryGltf(string const &path)
+    {
+        rg::GlbFile glb;
+        if(!glb.open(path))
+        {
+            cout << "ERROR::GLTF:: " << path << ": " << glb.error() << endl;
+            return;
+        }
+        const rg::JsonValue& json = glb.json();
+        // let the kernel fault in the geometry while we walk the JSON
+        for(unsigned int i = 0; i < json["bufferViews"].size(); i++)
+        {
+            int target = json["bufferViews"][i]["target"].asInt();
+            if(target == GL_ARRAY_BUFFER || target == GL_ELEMENT_ARRAY_BUFFER)
+                glb.prefetchBufferView(i);
+        }
+
+        map<int, unsigned int> viewBuffers; // buffer view -> GL buffer, shared by every primitive that reads from it
+        const rg::JsonValue& scenes = json["scenes"];
+        if(scenes.size() > 0)
+        {
+            const rg::JsonValue& scene = scenes[json["scene"].asInt(0)];
+            for(unsigned int i = 0; i < scene["nodes"].size(); i++)
+                processGltfNode(glb, scene["nodes"][i].asInt(), viewBuffers, 0);
+        }
+        else
+        {
+            for(unsigned int i = 0; i < json["meshes"].size(); i++)
+                processGltfMesh(glb, i, viewBuffers);
+        }
+        glBindVertexArray(0);
+    }
+
+    // like processNode, node transforms are not applied
+    void processGltfNode(const rg::GlbFile &glb, int nodeIndex, map<int, unsigned int> &viewBuffers, int depth)
+    {
+        const rg::JsonValue& node = glb.json()["nodes"][nodeIndex];
+        // glTF nodes form a forest, the depth check only guards against malformed files
+        if(!node.isObject() || depth > 64)
+            return;
+        if(node.has("mesh"))
+            processGltfMesh(glb, node["mesh"].asInt(), viewBuffers);
+        for(unsigned int i = 0; i < node["children"].size(); i++)
+            processGltfNode(glb, node["children"][i].asInt(), viewBuffers, depth + 1);
+    }
+
+    void processGltfMesh(const rg::GlbFile &glb, int meshIndex, map<int, unsigned int> &viewBuffers)
+    {
+        const rg::JsonValue& json = glb.json();
+        const rg::JsonValue& primitives = json["meshes"][meshIndex]["primitives"];
+        for(unsigned int p = 0; p < primitives.size(); p++)
+        {
+            const rg::JsonValue& primitive = primitives[p];
+            const rg::JsonValue& attributes = primitive["attributes"];
+            if(primitive["mode"].asInt(GL_TRIANGLES) != GL_TRIANGLES || !primitive.has("indices") || !attributes.has("POSITION"))
+            {
+                cout << "ERROR::GLTF:: skipping primitive " << p << " of mesh " << meshIndex << ", only indexed triangles are supported" << endl;
+                continue;
+            }
+            const rg::JsonValue& indices = json["accessors"][primitive["indices"].asInt()];
+            int indexView = indices["bufferView"].asInt(-1);
+            int indexType = indices["componentType"].asInt();
+            if(indexView < 0 || (indexType != GL_UNSIGNED_BYTE && indexType != GL_UNSIGNED_SHORT && indexType != GL_UNSIGNED_INT))
+            {
+                cout << "ERROR::GLTF:: mesh " << meshIndex << " has unsupported indices" << endl;
+                continue;
+            }
+
+            unsigned int VAO;
+            glGenVertexArrays(1, &VAO);
+            glBindVertexArray(VAO);
+            // same attribute locations as Mesh::setupMesh
+            if(!bindGltfAccessor(glb, attributes["POSITION"].asInt(), 0, viewBuffers))
+            {
+                cout << "ERROR::GLTF:: mesh " << meshIndex << " has unsupported positions" << endl;
+                glBindVertexArray(0);
+                glDeleteVertexArrays(1, &VAO);
+                continue;
+            }
+            if(attributes.has("NORMAL"))
+                bindGltfAccessor(glb, attributes["NORMAL"].asInt(), 1, viewBuffers);
+            if(attributes.has("TEXCOORD_0"))
+                bindGltfAccessor(glb, attributes["TEXCOORD_0"].asInt(), 2, viewBuffers);
+            const rg::JsonValue& material = json["materials"][primitive["material"].asInt(-1)];
+            bool hasTangents = false;
+            if(attributes.has("TANGENT"))
+                hasTangents = bindGltfAccessor(glb, attributes["TANGENT"].asInt(), 3, viewBuffers);
+            else if(material["normalTexture"].has("index"))
+                hasTangents = generateGltfTangents(glb, primitive); // glTF leaves this to the client when a normal mapped primitive has none
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gltfViewBuffer(glb, indexView, GL_ELEMENT_ARRAY_BUFFER, viewBuffers));
+            unsigned int depthVAO = createGltfDepthVAO(glb, attributes["POSITION"].asInt(), indexView, viewBuffers);
+
+            vector<Texture> textures;
+            const rg::JsonValue& baseColor = material["pbrMetallicRoughness"]["baseColorTexture"];
+            if(baseColor.has("index"))
+                textures.push_back(loadGltfTexture(glb, baseColor["index"].asInt(), TextureRole::Diffuse));
+            if(material["normalTexture"].has("index"))
+                textures.push_back(loadGltfTexture(glb, material["normalTexture"]["index"].asInt(), TextureRole::Normal));
+
+            meshes.push_back(Mesh(VAO, (GLsizei)indices["count"].asInt(), (GLenum)indexType,
+                                  (size_t)indices["byteOffset"].asInt(), textures));
+            meshes.back().hasTangents = hasTangents;
+            meshes.back().depthVAO = depthVAO;
+            meshes.back().transparent = material["alphaMode"].asString() == "BLEND";
+            // glTF requires min and max on POSITION accessors
+            const rg::JsonValue& positions = json["accessors"][attributes["POSITION"].asInt()];
+            if(positions["min"].size() == 3 && positions["max"].size() == 3)
+            {
+                meshes.back().bounds.add(glm::vec3(positions["min"][0].asFloat(), positions["min"][1].asFloat(), positions["min"][2].asFloat()));
+                meshes.back().bounds.add(glm::vec3(positions["max"][0].asFloat(), positions["max"][1].asFloat(), positions["max"][2].asFloat()));
+                meshes.back().sphere = rg::boundingSphere(meshes.back().bounds);
+            }
+        }
+    }
+
+    // GL buffer holding a whole buffer view, uploaded directly from the mapped file the first time it is needed
+    unsigned int gltfViewBuffer(const rg::GlbFile &glb, int viewIndex, GLenum target, map<int, unsigned int> &viewBuffers)
+    {
+        auto it = viewBuffers.find(viewIndex);
+        if(it != viewBuffers.end())
+            return it->second;
+        size_t length = 0;
+        const unsigned char* data = glb.bufferViewData(viewIndex, &length);
+        if(!data)
+            return 0;
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferData(target, length, data, GL_STATIC_DRAW);
+        buffers.push_back(buffer);
+        memoryBytes += length;
+        viewBuffers[viewIndex] = buffer;
+        return buffer;
+    }
+
+    // points a vertex attribute at an accessor. Every glTF component type is a GL type, so any accessor that lives in a
+    // buffer view can be read in place; sparse accessors would have to be expanded on the CPU and are not supported.
+    bool bindGltfAccessor(const rg::GlbFile &glb, int accessorIndex, GLuint location, map<int, unsigned int> &viewBuffers)
+    {
+        const rg::JsonValue& accessor = glb.json()["accessors"][accessorIndex];
+        int components = rg::gltfComponentCount(accessor["type"].asString());
+        int componentType = accessor["componentType"].asInt();
+        int view = accessor["bufferView"].asInt(-1);
+        if(components < 1 || components > 4 || rg::gltfComponentSize(componentType) == 0 || view < 0 || accessor.has("sparse"))
+            return false;
+        unsigned int buffer = gltfViewBuffer(glb, view, GL_ARRAY_BUFFER, viewBuffers);
+        if(!buffer)
+            return false;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, components, componentType, accessor["normalized"].asBool() ? GL_TRUE : GL_FALSE,
+                              glb.json()["bufferViews"][view]["byteStride"].asInt(0), (void*)(size_t)accessor["byteOffset"].asInt());
+        return true;
+    }
+
+    // position only VAO for depth passes (see Mesh::depthVAO). Exporters usually give POSITION a buffer view of its own,
+    // which is shared as is; interleaved positions are copied out into a packed buffer.
+    unsigned int createGltfDepthVAO(const rg::GlbFile &glb, int accessorIndex, int indexView, map<int, unsigned int> &viewBuffers)
+    {
+        const rg::JsonValue& accessor = glb.json()["accessors"][accessorIndex];
+        int stride = glb.json()["bufferViews"][accessor["bufferView"].asInt()]["byteStride"].asInt(0);
+        unsigned int depthVAO;
+        glGenVertexArrays(1, &depthVAO);
+        glBindVertexArray(depthVAO);
+        if(stride == 0 || stride == 3 * (int)sizeof(float))
+            bindGltfAccessor(glb, accessorIndex, 0, viewBuffers);
+        else
+        {
+            size_t positionStride = 0, count = 0;
+            const unsigned char* positions = gltfFloatAccessor(glb, accessorIndex, 3, positionStride, count);
+            if(!positions)
+            {
+                glBindVertexArray(0);
+                glDeleteVertexArrays(1, &depthVAO);
+                return 0;
+            }
+            vector<glm::vec3> packed(count);
+            for(size_t i = 0; i < count; i++)
+                memcpy(&packed[i], positions + i * positionStride, sizeof(glm::vec3));
+            unsigned int buffer;
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(glm::vec3), packed.data(), GL_STATIC_DRAW);
+            buffers.push_back(buffer);
+            memoryBytes += packed.size() * sizeof(glm::vec3);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gltfViewBuffer(glb, indexView, GL_ELEMENT_ARRAY_BUFFER, viewBuffers));
+        glBindVertexArray(0);
+        return depthVAO;
+    }
+
+    // in place view of a float accessor, for the few cases that need glTF vertex data on the CPU
+    const unsigned char* gltfFloatAccessor(const rg::GlbFile &glb, int accessorIndex, int components, size_t &stride, size_t &count)
+    {
+        const rg::JsonValue& accessor = glb.json()["accessors"][accessorIndex];
+        int view = accessor["bufferView"].asInt(-1);
+        size_t length = 0;
+        const unsigned char* data = glb.bufferViewData(view, &length);
+        if(!data || accessor["componentType"].asInt() != GL_FLOAT || accessor.has("sparse") ||
+           rg::gltfComponentCount(accessor["type"].asString()) != components)
+            return nullptr;
+        stride = (size_t)glb.json()["bufferViews"][view]["byteStride"].asInt(components * (int)sizeof(float));
+        count = (size_t)accessor["count"].asInt();
+        size_t offset = (size_t)accessor["byteOffset"].asInt();
+        if(count > 0 && offset + (count - 1) * stride + components * sizeof(float) > length)
+            return nullptr;
+        return data + offset;
+    }
+
+    // tangent stream for a normal mapped primitive, computed from the mapped accessors and bound to location 3 of the current VAO.
+    // The indices live in a GL buffer we do not rewrite, so vertices are not split on mirrored UVs here.
+    bool generateGltfTangents(const rg::GlbFile &glb, const rg::JsonValue &primitive)
+    {
+        const rg::JsonValue& attributes = primitive["attributes"];
+        const rg::JsonValue& indexAccessor = glb.json()["accessors"][primitive["indices"].asInt()];
+        rg::TangentInput input;
+        size_t positionCount = 0, normalCount = 0, uvCount = 0, indexLength = 0;
+        input.positions = gltfFloatAccessor(glb, attributes["POSITION"].asInt(), 3, input.positionStride, positionCount);
+        input.normals = attributes.has("NORMAL") ? gltfFloatAccessor(glb, attributes["NORMAL"].asInt(), 3, input.normalStride, normalCount) : nullptr;
+        input.texCoords = attributes.has("TEXCOORD_0") ? gltfFloatAccessor(glb, attributes["TEXCOORD_0"].asInt(), 2, input.texCoordStride, uvCount) : nullptr;
+        input.vertexCount = positionCount;
+        const unsigned char* indexData = glb.bufferViewData(indexAccessor["bufferView"].asInt(-1), &indexLength);
+        int indexType = indexAccessor["componentType"].asInt();
+        size_t indexSize = (size_t)rg::gltfComponentSize(indexType);
+        size_t indexCount = (size_t)indexAccessor["count"].asInt();
+        size_t indexOffset = (size_t)indexAccessor["byteOffset"].asInt();
+        if(!input.positions || !input.normals || !input.texCoords || normalCount < positionCount || uvCount < positionCount ||
+           !indexData || indexOffset + indexCount * indexSize > indexLength)
+        {
+            cout << "ERROR::GLTF:: cannot generate tangents, the primitive needs float normals and texture coordinates" << endl;
+            return false;
+        }
+
+        vector<unsigned int> indices(indexCount - indexCount % 3);
+        for(size_t i = 0; i < indices.size(); i++)
+        {
+            const unsigned char* p = indexData + indexOffset + i * indexSize;
+            if(indexType == GL_UNSIGNED_BYTE)
+                indices[i] = *p;
+            else if(indexType == GL_UNSIGNED_SHORT)
+                indices[i] = (unsigned int)rg::detail::fetch<unsigned short>(p, 0, 0);
+            else
+                indices[i] = rg::detail::fetch<unsigned int>(p, 0, 0);
+            if(indices[i] >= positionCount)
+            {
+                cout << "ERROR::GLTF:: index out of range, skipping tangent generation" << endl;
+                return false;
+            }
+        }
+        vector<glm::vec4> tangents = rg::generateTangents(input, indices, false, nullptr);
+
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec4), tangents.data(), GL_STATIC_DRAW);
+        buffers.push_back(buffer);
+        memoryBytes += tangents.size() * sizeof(glm::vec4);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        return true;
+    }
+
+    Texture loadGltfTexture(const rg::GlbFile &glb, int textureIndex, TextureRole role)
+    {
+        const rg::JsonValue& json = glb.json();
+        int imageIndex = json["textures"][textureIndex]["source"].asInt(-1);
+        // embedded images have no file name, key them by image index for textures_loaded
+        string key = "#image" + std::to_string(imageIndex);
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(textures_loaded[j].path == key && textures_loaded[j].role == role)
+                return textures_loaded[j];
+        }
+        const rg::JsonValue& image = json["images"][imageIndex];
+        Texture texture;
+        texture.role = role;
+        texture.path = key;
+        // glTF puts the UV origin in the top left corner, unlike the flipped OBJ/FBX convention the rest of the project
+        // loads with. The rows are flipped back instead of toggling stb_image's global flag, which workers decoding
+        // at the same time would see.
+        DecodedImage decoded;
+        rg::ResourceData file;
+        bool ok;
+        if(image.has("bufferView"))
+        {
+            size_t length = 0;
+            const unsigned char* data = glb.bufferViewData(image["bufferView"].asInt(), &length);
+            ok = DecodeImage(data, length, decoded, false);
+        }
+        else
+        {
+            string filename = this->directory + '/' + image["uri"].asString();
+            ok = rg::Resources::read(filename, file) && DecodeImage(file.data, file.size, decoded, false);
+        }
+        if(!ok)
+            std::cout << "Texture failed to load: " << key << std::endl;
+        texture.id = TextureFromImage(decoded);
+        memoryBytes += decoded.textureBytes();
+        textures_loaded.push_back(texture);
+        return texture;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureRole role)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
@@ -197,16 +804,27 @@ private:
             {
                 if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
                 {
-                    textures.push_back(textures_loaded[j]);
+                    // the same image may serve another role in this material
+                    Texture texture = textures_loaded[j];
+                    texture.role = role;
+                    textures.push_back(texture);
                     skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
                     break;
                 }
             }
             if(!skip)
-            {   // if texture hasn't been loaded already, load it
+            {   // if texture hasn't been loaded already, load it; deferred models keep the pixels for Upload
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
+                DecodedImage decoded;
+                if(!DecodeImageFile(str.C_Str(), this->directory, decoded))
+                    std::cout << "Texture failed to load at path: " << str.C_Str() << std::endl;
+                texture.id = 0;
+                if(deferred)
+                    pendingImages.push_back({str.C_Str(), decoded});
+                else
+                    texture.id = TextureFromImage(decoded);
+                memoryBytes += decoded.textureBytes();
+                texture.role = role;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
@@ -217,43 +835,76 @@ private:
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// decodes an encoded image, flipped vertically unless flip is false. Safe on any thread as long as nobody changes
+// stb_image's global flip flag meanwhile, which nothing does after startup.
+bool DecodeImage(const unsigned char *buffer, size_t length, DecodedImage &image, bool flip)
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
+    unsigned char *data = buffer ? stbi_load_from_memory(buffer, (int)length, &image.width, &image.height, &image.components, 0) : nullptr;
+    if (!data)
+        return false;
+    image.pixels.reset(data, stbi_image_free);
+    if (!flip)
+    {
+        size_t row = (size_t)image.width * image.components;
+        vector<unsigned char> swap(row);
+        for (int y = 0; y < image.height / 2; y++)
+        {
+            unsigned char *top = data + y * row, *bottom = data + (image.height - 1 - y) * row;
+            memcpy(swap.data(), top, row);
+            memcpy(top, bottom, row);
+            memcpy(bottom, swap.data(), row);
+        }
+    }
+    return true;
+}
 
+bool DecodeImageFile(const char *path, const string &directory, DecodedImage &image)
+{
+    rg::ResourceData file;
+    return rg::Resources::read(directory + '/' + string(path), file) && DecodeImage(file.data, file.size, image);
+}
+
+// uploads the pixels into a new texture object; one without pixels stays empty and samples as black
+unsigned int TextureFromImage(const DecodedImage &image)
+{
     unsigned int textureID;
     glGenTextures(1, &textureID);
+    if (!image.pixels)
+        return textureID;
+
+    GLenum format;
+    if (image.components == 1)
+        format = GL_RED;
+    else if (image.components == 3)
+        format = GL_RGB;
+    else if (image.components == 4)
+        format = GL_RGBA;
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+    DecodedImage image;
+    if (!DecodeImageFile(path, directory, image))
         std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    return TextureFromImage(image);
+}
 
-    return textureID;
+// same as TextureFromFile for an encoded image that is already in memory (e.g. embedded in a .glb)
+unsigned int TextureFromMemory(const unsigned char *buffer, size_t length, bool gamma)
+{
+    DecodedImage image;
+    if (!DecodeImage(buffer, length, image))
+        std::cout << "Texture failed to load from memory" << std::endl;
+    return TextureFromImage(image);
 }
 #endif
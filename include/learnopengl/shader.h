@@ -9,13 +9,57 @@
 #include <sstream>
 #include <iostream>
 #include <common.h>
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+#include <rg/GLState.h>
+#include <rg/Hash.h>
+#include <rg/ProgramCache.h>
+#include <rg/Resources.h>
+
+// Uniform name reduced to its hash. Literals written as "name"_u are hashed by the constexpr constructor, so with
+// optimization on the setters below compile to a table probe and the glUniform call, without building any string.
+struct UniformName
+{
+    uint64_t hash;
+    constexpr UniformName(const char* name) : hash(rg::fnv1a(name, length(name))) {}
+    UniformName(const std::string &name) : hash(rg::fnv1a(name)) {}
+    constexpr explicit UniformName(uint64_t hash) : hash(hash) {}
+
+private:
+    static constexpr size_t length(const char* name)
+    {
+        size_t n = 0;
+        while (name[n])
+            ++n;
+        return n;
+    }
+};
+
+constexpr UniformName operator""_u(const char* name, size_t length)
+{
+    return UniformName(rg::fnv1a(name, length));
+}
+
+// Immediate builds are usable when the constructor returns. Deferred builds only submit the work to the driver;
+// call finish() (or poll isReady() first) before using the program.
+enum class ShaderBuild
+{
+    Immediate,
+    Deferred
+};
+
 class Shader
 {
 public:
+    // vertex attributes from this location up are per instance (the mat4 of Model::DrawInstanced takes 4)
+    static constexpr GLuint kInstanceAttribute = 4;
+
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, defines ("#define NAME value" lines) go right after #version
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string &defines = "",
+           ShaderBuild build = ShaderBuild::Immediate)
     {
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
@@ -26,152 +70,298 @@ public:
         std::string vertexCode;
         std::string fragmentCode;
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
+        // sources come from the mounted resource pack when there is one, otherwise from disk
+        if (!rg::Resources::readText(vertexPath, vertexCode) || !rg::Resources::readText(fragmentPath, fragmentCode) ||
+            (geometryPath != nullptr && !rg::Resources::readText(geometryPath, geometryCode)))
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
+        if (!defines.empty())
         {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            vertexCode = injectDefines(vertexCode, defines);
+            fragmentCode = injectDefines(fragmentCode, defines);
+            if (geometryPath != nullptr)
+                geometryCode = injectDefines(geometryCode, defines);
         }
-        // shader Program
+        // 2. a binary cached by an earlier launch on the same driver skips compilation entirely
         ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
+        uint64_t cacheKey = rg::ProgramCache::key({vertexCode, fragmentCode, geometryCode}, defines);
+        if (rg::ProgramCache::load(ID, cacheKey))
+        {
+            resolveUniforms();
+            resolveAttributes();
+            return;
+        }
+        // 3. compile shaders and link. Nothing is queried here: the driver is free to work on several programs at
+        // once (on its own threads with GL_KHR_parallel_shader_compile) until finish() asks for the results
+        m_Stages.push_back({compileStage(GL_VERTEX_SHADER, vertexCode), "VERTEX"});
+        m_Stages.push_back({compileStage(GL_FRAGMENT_SHADER, fragmentCode), "FRAGMENT"});
+        // if geometry shader is given, compile geometry shader
         if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
+            m_Stages.push_back({compileStage(GL_GEOMETRY_SHADER, geometryCode), "GEOMETRY"});
+        // shader Program
+        for (const auto &stage : m_Stages)
+            glAttachShader(ID, stage.first);
+        rg::ProgramCache::prepare(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        m_CacheKey = cacheKey;
+        m_Pending = true;
+        if (build == ShaderBuild::Immediate)
+            finish();
     }
-    // activate the shader
+    // compute program (GL 4.3, see rg::GLExtensions::computeShaders), built right away; run it with
+    // glext().DispatchCompute after use()
     // ------------------------------------------------------------------------
-    void use() 
-    { 
-        glUseProgram(ID); 
+    static Shader compute(const char* computePath, const std::string &defines = "")
+    {
+        Shader shader;
+        std::string computeCode;
+        if (!rg::Resources::readText(computePath, computeCode))
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        if (!defines.empty())
+            computeCode = injectDefines(computeCode, defines);
+        shader.ID = glCreateProgram();
+        uint64_t cacheKey = rg::ProgramCache::key({computeCode}, defines);
+        if (rg::ProgramCache::load(shader.ID, cacheKey))
+        {
+            shader.resolveUniforms();
+            return shader;
+        }
+        shader.m_Stages.push_back({compileStage(GL_COMPUTE_SHADER, computeCode), "COMPUTE"});
+        glAttachShader(shader.ID, shader.m_Stages.back().first);
+        rg::ProgramCache::prepare(shader.ID);
+        glLinkProgram(shader.ID);
+        shader.m_CacheKey = cacheKey;
+        shader.m_Pending = true;
+        shader.finish();
+        return shader;
     }
-    // utility uniform functions
+    // false while the driver is still compiling or linking a deferred program. Without parallel shader compile
+    // support there is no way to ask, so it reports true and finish() waits like the immediate build does.
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
-    {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    bool isReady() const
+    {
+        if (!m_Pending || !rg::glext().parallelShaderCompile())
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
     }
+    // collects the compile and link results of a deferred program (blocking if needed) and makes it usable
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
-    { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    void finish()
+    {
+        if (!m_Pending)
+            return;
+        m_Pending = false;
+        for (const auto &stage : m_Stages)
+            checkCompileErrors(stage.first, stage.second);
+        if (checkCompileErrors(ID, "PROGRAM"))
+            rg::ProgramCache::store(ID, m_CacheKey);
+        resolveUniforms();
+        resolveAttributes();
+        // delete the shaders as they're linked into our program now and no longer necessery
+        for (const auto &stage : m_Stages)
+            glDeleteShader(stage.first);
+        m_Stages.clear();
     }
+    // finishes deferred programs in the order the driver completes them instead of the order they were created
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
-    { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+    static void finishAll(std::initializer_list<Shader*> shaders)
+    {
+        std::vector<Shader*> pending(shaders);
+        while (!pending.empty())
+        {
+            auto ready = std::find_if(pending.begin(), pending.end(), [](Shader *shader) { return shader->isReady(); });
+            // nothing done yet, wait on the oldest one
+            if (ready == pending.end())
+                ready = pending.begin();
+            (*ready)->finish();
+            pending.erase(ready);
+        }
     }
+    // activate the shader
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
-    { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
-    }
-    void setVec2(const std::string &name, float x, float y) const
+    void use() 
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        rg::GLState::useProgram(ID); 
     }
+    // location of an active uniform, -1 if the program has none by that name (glUniform* ignores -1).
+    // Callers on the hot path can keep the returned location and use the GLint overloads below.
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
-    { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    GLint location(UniformName name) const
+    {
+        if (m_Locations.empty())
+            return -1;
+        size_t mask = m_Locations.size() - 1;
+        for (size_t i = name.hash & mask; ; i = (i + 1) & mask)
+        {
+            if (m_Locations[i].hash == name.hash)
+                return m_Locations[i].location;
+            if (m_Locations[i].hash == 0)
+                return -1;
+        }
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
-    { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+    // true if the vertex shader reads no per vertex attribute but 0 (the position), so meshes can bind their packed
+    // position stream instead of the full vertex layout
+    bool readsPositionOnly() const
+    {
+        return m_PositionOnly;
+    }
+    // attaches the program's uniform block to a binding point, programs without the block are left alone
+    void bindUniformBlock(const char* blockName, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, blockName);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
     }
+    // utility uniform functions
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
-    { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    void setBool(GLint location, bool value) const { glUniform1i(location, (int)value); }
+    void setBool(UniformName name, bool value) const { setBool(location(name), value); }
+    // ------------------------------------------------------------------------
+    void setInt(GLint location, int value) const { glUniform1i(location, value); }
+    void setInt(UniformName name, int value) const { setInt(location(name), value); }
+    // ------------------------------------------------------------------------
+    void setFloat(GLint location, float value) const { glUniform1f(location, value); }
+    void setFloat(UniformName name, float value) const { setFloat(location(name), value); }
+    // ------------------------------------------------------------------------
+    void setVec2(GLint location, const glm::vec2 &value) const { glUniform2fv(location, 1, &value[0]); }
+    void setVec2(UniformName name, const glm::vec2 &value) const { setVec2(location(name), value); }
+    void setVec2(UniformName name, float x, float y) const { glUniform2f(location(name), x, y); }
+    // ------------------------------------------------------------------------
+    void setVec3(GLint location, const glm::vec3 &value) const { glUniform3fv(location, 1, &value[0]); }
+    void setVec3(UniformName name, const glm::vec3 &value) const { setVec3(location(name), value); }
+    void setVec3(UniformName name, float x, float y, float z) const { glUniform3f(location(name), x, y, z); }
+    // ------------------------------------------------------------------------
+    void setVec4(GLint location, const glm::vec4 &value) const { glUniform4fv(location, 1, &value[0]); }
+    void setVec4(UniformName name, const glm::vec4 &value) const { setVec4(location(name), value); }
+    void setVec4(UniformName name, float x, float y, float z, float w) const { glUniform4f(location(name), x, y, z, w); }
+    // ------------------------------------------------------------------------
+    void setMat2(GLint location, const glm::mat2 &mat) const { glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]); }
+    void setMat2(UniformName name, const glm::mat2 &mat) const { setMat2(location(name), mat); }
+    // ------------------------------------------------------------------------
+    void setMat3(GLint location, const glm::mat3 &mat) const { glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]); }
+    void setMat3(UniformName name, const glm::mat3 &mat) const { setMat3(location(name), mat); }
+    // ------------------------------------------------------------------------
+    void setMat4(GLint location, const glm::mat4 &mat) const { glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]); }
+    void setMat4(UniformName name, const glm::mat4 &mat) const { setMat4(location(name), mat); }
+    // whole array in one call, name is the array itself ("shadowMatrices"_u)
+    void setMat4(UniformName name, const glm::mat4 *mats, GLsizei count) const
+    {
+        glUniformMatrix4fv(location(name), count, GL_FALSE, &mats[0][0][0]);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
-    { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+
+private:
+    Shader() : ID(0) {}
+
+    // stages of a deferred build, kept until finish() has checked them
+    std::vector<std::pair<GLuint, const char*>> m_Stages;
+    uint64_t m_CacheKey = 0;
+    bool m_Pending = false;
+
+    static GLuint compileStage(GLenum type, const std::string &source)
+    {
+        const char* code = source.c_str();
+        GLuint stage = glCreateShader(type);
+        glShaderSource(stage, 1, &code, NULL);
+        glCompileShader(stage);
+        return stage;
     }
-    // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+
+    // #version has to stay the first directive, defines go on the line after it
+    static std::string injectDefines(const std::string &source, const std::string &defines)
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        size_t version = source.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + source;
+        return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
     }
-    // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+
+    struct UniformSlot
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        uint64_t hash;
+        GLint location;
+    };
+    // open addressing table, power of two sized and at most half full; hash 0 marks an empty slot
+    std::vector<UniformSlot> m_Locations;
+    bool m_PositionOnly = false;
+
+    void insertLocation(uint64_t hash, GLint location)
+    {
+        size_t mask = m_Locations.size() - 1;
+        size_t i = hash & mask;
+        while (m_Locations[i].hash != 0 && m_Locations[i].hash != hash)
+            i = (i + 1) & mask;
+        m_Locations[i] = {hash, location};
     }
-    // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+
+    // sets m_PositionOnly when no attribute other than location 0 is read below the instance attributes
+    void resolveAttributes()
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer((size_t)maxLength + 1);
+        m_PositionOnly = true;
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveAttrib(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), (size_t)length);
+            if (name.compare(0, 3, "gl_") == 0)
+                continue; // gl_VertexID and friends are listed by some drivers
+            GLint location = glGetAttribLocation(ID, name.c_str());
+            if (location > 0 && (GLuint)location < kInstanceAttribute)
+                m_PositionOnly = false;
+        }
     }
 
-private:
-    // utility function for checking shader compilation/linking errors.
+    // one pass over the active uniforms after link. Arrays are reported as "name[0]"; they are entered under
+    // "name", "name[0]" and every "name[i]", so old style per element calls keep working.
+    void resolveUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<std::pair<std::string, GLint>> entries;
+        std::vector<GLchar> buffer((size_t)maxLength + 1);
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), (size_t)length);
+            GLint loc = glGetUniformLocation(ID, name.c_str());
+            if (loc < 0)
+                continue; // uniform block member
+            entries.emplace_back(name, loc);
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                entries.emplace_back(base, loc);
+                for (GLint element = 1; element < size; ++element)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    entries.emplace_back(elementName, glGetUniformLocation(ID, elementName.c_str()));
+                }
+            }
+        }
+        size_t capacity = 16;
+        while (capacity < entries.size() * 2)
+            capacity *= 2;
+        m_Locations.assign(capacity, UniformSlot{0, -1});
+        for (const auto &entry : entries)
+            insertLocation(rg::fnv1a(entry.first), entry.second);
+    }
+
+    // utility function for checking shader compilation/linking errors, returns true on success.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -193,6 +383,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success;
     }
 };
 #endif
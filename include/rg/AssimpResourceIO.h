@@ -0,0 +1,71 @@
+#ifndef PROJECT_BASE_ASSIMPRESOURCEIO_H
+#define PROJECT_BASE_ASSIMPRESOURCEIO_H
+
+#include <algorithm>
+#include <cstring>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <rg/Resources.h>
+
+namespace rg {
+
+// Lets ASSIMP open the model and everything it references (MTL files etc.) through rg::Resources.
+class ResourceIOStream : public Assimp::IOStream {
+    ResourceData m_Data;
+    size_t m_Position = 0;
+public:
+    explicit ResourceIOStream(ResourceData data) : m_Data(std::move(data)) {}
+
+    size_t Read(void* buffer, size_t size, size_t count) override {
+        if (size == 0)
+            return 0;
+        size_t items = std::min(count, (m_Data.size - m_Position) / size);
+        if (items)
+            std::memcpy(buffer, m_Data.data + m_Position, items * size);
+        m_Position += items * size;
+        return items;
+    }
+
+    size_t Write(const void*, size_t, size_t) override {
+        return 0;
+    }
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override {
+        size_t base = origin == aiOrigin_SET ? 0 : (origin == aiOrigin_CUR ? m_Position : m_Data.size);
+        if (base + offset > m_Data.size)
+            return aiReturn_FAILURE;
+        m_Position = base + offset;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override { return m_Position; }
+    size_t FileSize() const override { return m_Data.size; }
+    void Flush() override {}
+};
+
+class ResourceIOSystem : public Assimp::IOSystem {
+public:
+    bool Exists(const char* path) const override {
+        return Resources::exists(path);
+    }
+
+    char getOsSeparator() const override {
+        return '/';
+    }
+
+    Assimp::IOStream* Open(const char* path, const char* mode = "rb") override {
+        if (std::strchr(mode, 'w') || std::strchr(mode, 'a'))
+            return nullptr;
+        ResourceData data;
+        if (!Resources::read(path, data))
+            return nullptr;
+        return new ResourceIOStream(std::move(data));
+    }
+
+    void Close(Assimp::IOStream* stream) override {
+        delete stream;
+    }
+};
+
+}
+#endif //PROJECT_BASE_ASSIMPRESOURCEIO_H
@@ -0,0 +1,72 @@
+#ifndef PROJECT_BASE_BOUNDS_H
+#define PROJECT_BASE_BOUNDS_H
+
+#include <cfloat>
+#include <cmath>
+#include <glm/glm.hpp>
+
+namespace rg {
+
+// Axis aligned box. The default one is empty (min > max) and grows with every point added.
+struct Aabb {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool empty() const { return min.x > max.x; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+    void add(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void add(const Aabb& box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+};
+
+struct Sphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+// box around the transformed box: the center moves with the transform, the extent is projected on the world axes
+// through the absolute matrix (Arvo). Exact for rotations of the box, never smaller than the transformed corners.
+inline Aabb transformAabb(const Aabb& box, const glm::mat4& transform) {
+    if (box.empty())
+        return box;
+    glm::vec3 center = glm::vec3(transform * glm::vec4(box.center(), 1.0f));
+    glm::vec3 extent = box.extent();
+    glm::vec3 worldExtent(0.0f);
+    for (int column = 0; column < 3; ++column)
+        worldExtent += glm::abs(glm::vec3(transform[column])) * extent[column];
+    Aabb result;
+    result.min = center - worldExtent;
+    result.max = center + worldExtent;
+    return result;
+}
+
+// sphere around a box, looser than the box but cheap to move and test against distances
+inline Sphere boundingSphere(const Aabb& box) {
+    Sphere sphere;
+    if (box.empty())
+        return sphere;
+    sphere.center = box.center();
+    sphere.radius = glm::length(box.extent());
+    return sphere;
+}
+
+inline Sphere transformSphere(const Sphere& sphere, const glm::mat4& transform) {
+    Sphere result;
+    result.center = glm::vec3(transform * glm::vec4(sphere.center, 1.0f));
+    float scale = std::sqrt(std::fmax(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+                             std::fmax(glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])),
+                                       glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2])))));
+    result.radius = sphere.radius * scale;
+    return result;
+}
+
+}
+#endif //PROJECT_BASE_BOUNDS_H
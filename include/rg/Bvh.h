@@ -0,0 +1,253 @@
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+#include <rg/FrustumCulling.h>
+
+namespace rg {
+
+// Node of the flat node array. Leaves (count > 0) own items [first, first + count) of the leaf order; inner nodes
+// have their children at first and first + 1, always after themselves, so walking the array backwards visits
+// children before parents.
+struct BvhNode {
+    Aabb bounds;
+    uint32_t first;
+    uint32_t count;
+};
+
+// Bounding volume hierarchy over item boxes, items being whatever the caller numbers 0..n-1 (the scene numbers its
+// meshes). build() uses a binned surface area heuristic; refit() keeps the topology and only grows and shrinks the
+// node boxes, which is what moving objects need as long as they do not wander too far from where they were built.
+// Items without bounds are kept out of the tree and reported by every query.
+class Bvh {
+    static const uint32_t kLeafItems = 4;
+    static const int kBins = 8;
+
+    std::vector<BvhNode> m_Nodes;
+    std::vector<uint32_t> m_Items;     // leaf order
+    std::vector<uint32_t> m_Unbounded;
+    std::vector<Aabb> m_Bounds;        // by item
+    std::vector<glm::vec3> m_Centroids;
+    mutable std::vector<uint32_t> m_Stack;
+
+    static float area(const Aabb& box) {
+        if (box.empty())
+            return 0.0f;
+        glm::vec3 size = box.max - box.min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    // classifies the box against the planes still in mask; returns false if it is outside, clears the planes it is
+    // entirely inside of
+    static bool classify(const Aabb& box, const Frustum& frustum, uint32_t& mask) {
+        glm::vec3 center = box.center(), extent = box.extent();
+        for (int p = 0; p < 6; ++p) {
+            if (!(mask & (1u << p)))
+                continue;
+            const glm::vec4& plane = frustum.planes[p];
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+            if (distance + radius < 0.0f)
+                return false;
+            if (distance - radius >= 0.0f)
+                mask &= ~(1u << p);
+        }
+        return true;
+    }
+
+    static bool overlapsSphere(const Aabb& box, const glm::vec3& center, float radius) {
+        glm::vec3 closest = glm::clamp(center, box.min, box.max);
+        glm::vec3 offset = closest - center;
+        return glm::dot(offset, offset) <= radius * radius;
+    }
+
+    void buildNode(uint32_t index, uint32_t first, uint32_t count) {
+        Aabb bounds, centroids;
+        for (uint32_t i = first; i < first + count; ++i) {
+            bounds.add(m_Bounds[m_Items[i]]);
+            centroids.add(m_Centroids[m_Items[i]]);
+        }
+        m_Nodes[index].bounds = bounds;
+        m_Nodes[index].first = first;
+        m_Nodes[index].count = count;
+        if (count <= kLeafItems)
+            return;
+
+        // best split plane over all axes between kBins bins of the centroid range
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = area(bounds) * (float)count; // cost of staying a leaf
+        for (int axis = 0; axis < 3; ++axis) {
+            float low = centroids.min[axis], extent = centroids.max[axis] - low;
+            if (extent <= 0.0f)
+                continue;
+            Aabb binBounds[kBins];
+            uint32_t binCounts[kBins] = {};
+            for (uint32_t i = first; i < first + count; ++i) {
+                int bin = std::min(kBins - 1, (int)((m_Centroids[m_Items[i]][axis] - low) / extent * kBins));
+                binBounds[bin].add(m_Bounds[m_Items[i]]);
+                ++binCounts[bin];
+            }
+            float rightArea[kBins];
+            uint32_t rightCount[kBins];
+            Aabb right;
+            uint32_t rightItems = 0;
+            for (int bin = kBins - 1; bin > 0; --bin) {
+                right.add(binBounds[bin]);
+                rightItems += binCounts[bin];
+                rightArea[bin] = area(right);
+                rightCount[bin] = rightItems;
+            }
+            Aabb left;
+            uint32_t leftItems = 0;
+            for (int split = 1; split < kBins; ++split) {
+                left.add(binBounds[split - 1]);
+                leftItems += binCounts[split - 1];
+                if (leftItems == 0 || rightCount[split] == 0)
+                    continue;
+                float cost = area(left) * (float)leftItems + rightArea[split] * (float)rightCount[split];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        uint32_t leftCount;
+        if (bestAxis >= 0) {
+            float low = centroids.min[bestAxis], extent = centroids.max[bestAxis] - low;
+            uint32_t* middle = std::partition(&m_Items[first], &m_Items[first] + count, [&](uint32_t item) {
+                return std::min(kBins - 1, (int)((m_Centroids[item][bestAxis] - low) / extent * kBins)) < bestSplit;
+            });
+            leftCount = (uint32_t)(middle - &m_Items[first]);
+        } else if (count > 4 * kLeafItems) {
+            // SAH prefers a leaf (e.g. all centroids in one spot), but a huge leaf makes every query slow
+            leftCount = count / 2;
+        } else
+            return;
+
+        uint32_t children = (uint32_t)m_Nodes.size();
+        m_Nodes.resize(m_Nodes.size() + 2);
+        m_Nodes[index].first = children;
+        m_Nodes[index].count = 0;
+        buildNode(children, first, leftCount);
+        buildNode(children + 1, first + leftCount, count - leftCount);
+    }
+
+public:
+    void build(const std::vector<Aabb>& bounds) {
+        m_Bounds = bounds;
+        m_Nodes.clear();
+        m_Items.clear();
+        m_Unbounded.clear();
+        m_Centroids.resize(bounds.size());
+        for (uint32_t i = 0; i < (uint32_t)bounds.size(); ++i) {
+            if (bounds[i].empty()) {
+                m_Unbounded.push_back(i);
+                continue;
+            }
+            m_Centroids[i] = bounds[i].center();
+            m_Items.push_back(i);
+        }
+        if (m_Items.empty())
+            return;
+        m_Nodes.reserve(2 * m_Items.size());
+        m_Nodes.resize(1);
+        buildNode(0, 0, (uint32_t)m_Items.size());
+    }
+
+    // new boxes for the same items; false (and nothing done) if none changed. A different item count, or an item
+    // gaining or losing its bounds, changes the tree's item set and falls back to build().
+    bool refit(const std::vector<Aabb>& bounds) {
+        if (bounds.size() == m_Bounds.size() &&
+            std::memcmp(bounds.data(), m_Bounds.data(), bounds.size() * sizeof(Aabb)) == 0)
+            return false;
+        bool sameItems = bounds.size() == m_Bounds.size();
+        for (size_t i = 0; sameItems && i < bounds.size(); ++i)
+            sameItems = bounds[i].empty() == m_Bounds[i].empty();
+        if (!sameItems) {
+            build(bounds);
+            return true;
+        }
+        m_Bounds = bounds;
+        for (size_t n = m_Nodes.size(); n-- > 0;) {
+            BvhNode& node = m_Nodes[n];
+            Aabb box;
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i)
+                    box.add(m_Bounds[m_Items[i]]);
+            } else {
+                box.add(m_Nodes[node.first].bounds);
+                box.add(m_Nodes[node.first + 1].bounds);
+            }
+            node.bounds = box;
+        }
+        return true;
+    }
+
+    // visit(item, inside) for every item in a leaf that intersects the frustum; inside is true if the leaf is entirely
+    // within it, false if the caller still has to test the item's own box (FrustumCuller does that four at a time)
+    template<typename Visit>
+    void queryFrustum(const Frustum& frustum, Visit visit) const {
+        for (uint32_t item : m_Unbounded)
+            visit(item, false);
+        if (m_Nodes.empty())
+            return;
+        // node index and the planes the node is not yet known to be inside of, packed in one word
+        m_Stack.clear();
+        m_Stack.push_back(0x3Fu << 26);
+        while (!m_Stack.empty()) {
+            uint32_t entry = m_Stack.back();
+            m_Stack.pop_back();
+            const BvhNode& node = m_Nodes[entry & 0x03FFFFFFu];
+            uint32_t mask = entry >> 26;
+            if (!classify(node.bounds, frustum, mask))
+                continue;
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i)
+                    visit(m_Items[i], mask == 0);
+                continue;
+            }
+            m_Stack.push_back(node.first | (mask << 26));
+            m_Stack.push_back((node.first + 1) | (mask << 26));
+        }
+    }
+
+    // visit(item) for every item whose box overlaps the sphere (shadow casters of a light, objects a light reaches)
+    template<typename Visit>
+    void querySphere(const glm::vec3& center, float radius, Visit visit) const {
+        for (uint32_t item : m_Unbounded)
+            visit(item);
+        if (m_Nodes.empty())
+            return;
+        m_Stack.clear();
+        m_Stack.push_back(0);
+        while (!m_Stack.empty()) {
+            const BvhNode& node = m_Nodes[m_Stack.back()];
+            m_Stack.pop_back();
+            if (!overlapsSphere(node.bounds, center, radius))
+                continue;
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    if (overlapsSphere(m_Bounds[m_Items[i]], center, radius))
+                        visit(m_Items[i]);
+                }
+                continue;
+            }
+            m_Stack.push_back(node.first);
+            m_Stack.push_back(node.first + 1);
+        }
+    }
+
+    size_t size() const { return m_Bounds.size(); }
+    const std::vector<BvhNode>& nodes() const { return m_Nodes; }
+};
+
+}
+#endif //PROJECT_BASE_BVH_H
@@ -0,0 +1,176 @@
+#ifndef PROJECT_BASE_CUBEMAP_H
+#define PROJECT_BASE_CUBEMAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <rg/GLExtensions.h>
+#include <rg/Resources.h>
+#include <rg/ThreadPool.h>
+
+namespace rg {
+
+// One decoded face, always RGBA8 so rows need no unpack alignment care.
+struct CubemapFace {
+    std::string path;
+    int width = 0;
+    int height = 0;
+    std::shared_ptr<unsigned char> pixels;
+};
+
+// Starts decoding the six faces (+X, -X, +Y, -Y, +Z, -Z) on the shared pool and returns right away, so the decode
+// overlaps whatever the caller does next. stb_image reads the global flip flag while decoding: do not toggle it
+// before the faces are uploaded.
+inline std::vector<std::future<CubemapFace>> decodeCubemapAsync(const std::vector<std::string>& paths) {
+    std::vector<std::future<CubemapFace>> faces;
+    for (const std::string& path : paths) {
+        faces.push_back(ThreadPool::shared().submit([path] {
+            CubemapFace face;
+            face.path = path;
+            ResourceData file;
+            int channels = 0;
+            unsigned char* data = Resources::read(path, file) ?
+                    stbi_load_from_memory(file.data, (int)file.size, &face.width, &face.height, &channels, STBI_rgb_alpha) : nullptr;
+            if (data)
+                face.pixels.reset(data, stbi_image_free);
+            return face;
+        }));
+    }
+    return faces;
+}
+
+inline void setCubemapParameters(bool mipmapped) {
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+// Waits for the decoded faces and uploads them into one GL_RGB8 cubemap with a full mip chain. Storage is allocated
+// once and immutable when the driver has texture storage (GL 4.2 / ARB_texture_storage).
+inline unsigned int createCubemap(std::vector<std::future<CubemapFace>>& pending) {
+    std::vector<CubemapFace> faces;
+    for (auto& face : pending)
+        faces.push_back(face.get());
+    pending.clear();
+
+    int size = 0;
+    for (const CubemapFace& face : faces) {
+        if (face.pixels && !size)
+            size = face.width;
+    }
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    if (!size) {
+        std::cout << "Cubemap tex failed to load, no face could be decoded" << std::endl;
+        return textureID;
+    }
+
+    int levels = 1;
+    for (int s = size; s > 1; s >>= 1)
+        ++levels;
+    bool immutable = glext().textureStorage();
+    if (immutable)
+        glext().TexStorage2D(GL_TEXTURE_CUBE_MAP, levels, GL_RGB8, size, size);
+    for (unsigned int i = 0; i < faces.size() && i < 6; i++) {
+        const CubemapFace& face = faces[i];
+        if (!face.pixels || face.width != size || face.height != size) {
+            std::cout << "Cubemap tex failed to load at path: " << face.path << std::endl;
+            continue;
+        }
+        if (immutable)
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, face.pixels.get());
+        else
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, face.pixels.get());
+    }
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    setCubemapParameters(true);
+    return textureID;
+}
+
+// Loads a cubemap written ahead of time as KTX 1.1 (little endian, six faces, any compressed or uncompressed format
+// the driver accepts), e.g. with toktx or compressonator. Faces are expected in GL orientation, the data is uploaded
+// as is. Returns 0 when the file is missing, malformed or its format is not supported, so the caller can fall back.
+inline unsigned int loadKtxCubemap(const std::string& path) {
+    static const unsigned char kIdentifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+    ResourceData file;
+    if (!Resources::exists(path) || !Resources::read(path, file))
+        return 0;
+    const unsigned char* data = file.data;
+    const size_t size = file.size;
+    if (size < 64 || std::memcmp(data, kIdentifier, sizeof(kIdentifier)) != 0) {
+        std::cout << "ERROR::CUBEMAP:: " << path << " is not a KTX file" << std::endl;
+        return 0;
+    }
+    uint32_t header[13];
+    std::memcpy(header, data + 12, sizeof(header));
+    const uint32_t endianness = header[0], glType = header[1], glFormat = header[3], glInternalFormat = header[4];
+    const uint32_t width = header[6], height = header[7], depth = header[8], arrayElements = header[9];
+    const uint32_t faceCount = header[10], keyValueBytes = header[12];
+    const uint32_t mipLevels = std::max<uint32_t>(header[11], 1);
+    if (endianness != 0x04030201 || faceCount != 6 || arrayElements != 0 || depth != 0 || width != height || width == 0) {
+        std::cout << "ERROR::CUBEMAP:: " << path << " is not a little endian KTX cubemap" << std::endl;
+        return 0;
+    }
+
+    while (glGetError() != GL_NO_ERROR) {}
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    bool immutable = glext().textureStorage();
+    if (immutable)
+        glext().TexStorage2D(GL_TEXTURE_CUBE_MAP, (GLsizei)mipLevels, glInternalFormat, (GLsizei)width, (GLsizei)height);
+
+    size_t offset = 64 + (size_t)keyValueBytes;
+    bool truncated = false;
+    for (uint32_t level = 0; level < mipLevels && !truncated; ++level) {
+        GLsizei levelSize = (GLsizei)std::max<uint32_t>(width >> level, 1);
+        if (offset + 4 > size) {
+            truncated = true;
+            break;
+        }
+        uint32_t imageSize;
+        std::memcpy(&imageSize, data + offset, 4);
+        offset += 4;
+        for (unsigned int i = 0; i < 6; ++i) {
+            if (offset + imageSize > size) {
+                truncated = true;
+                break;
+            }
+            const void* pixels = data + offset;
+            GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+            if (glType == 0 && immutable)
+                glCompressedTexSubImage2D(target, (GLint)level, 0, 0, levelSize, levelSize, glInternalFormat, (GLsizei)imageSize, pixels);
+            else if (glType == 0)
+                glCompressedTexImage2D(target, (GLint)level, glInternalFormat, levelSize, levelSize, 0, (GLsizei)imageSize, pixels);
+            else if (immutable)
+                glTexSubImage2D(target, (GLint)level, 0, 0, levelSize, levelSize, glFormat, glType, pixels);
+            else
+                glTexImage2D(target, (GLint)level, (GLint)glInternalFormat, levelSize, levelSize, 0, glFormat, glType, pixels);
+            // faces and levels are padded to 4 bytes
+            offset += (imageSize + 3u) & ~(size_t)3;
+        }
+    }
+    if (!immutable)
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, (GLint)mipLevels - 1);
+    setCubemapParameters(mipLevels > 1);
+
+    if (truncated || glGetError() != GL_NO_ERROR) {
+        std::cout << "ERROR::CUBEMAP:: " << path << (truncated ? " is truncated" : " uses a format this driver does not support") << std::endl;
+        glDeleteTextures(1, &textureID);
+        return 0;
+    }
+    return textureID;
+}
+
+}
+#endif //PROJECT_BASE_CUBEMAP_H
@@ -0,0 +1,112 @@
+#ifndef PROJECT_BASE_FRUSTUMCULLING_H
+#define PROJECT_BASE_FRUSTUMCULLING_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RG_CULL_SSE 1
+#endif
+
+namespace rg {
+
+// Six planes (xyz normal pointing inside, w distance) taken from a view projection matrix (Gribb/Hartmann).
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4& viewProjection) {
+        glm::mat4 m = glm::transpose(viewProjection); // rows of the GLM column major matrix
+        Frustum frustum;
+        frustum.planes[0] = m[3] + m[0]; // left
+        frustum.planes[1] = m[3] - m[0]; // right
+        frustum.planes[2] = m[3] + m[1]; // bottom
+        frustum.planes[3] = m[3] - m[1]; // top
+        frustum.planes[4] = m[3] + m[2]; // near
+        frustum.planes[5] = m[3] - m[2]; // far
+        for (glm::vec4& plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+};
+
+// World space boxes in structure of arrays form, tested against a frustum four at a time with SSE (scalar where SSE
+// is missing). A box is outside if it lies entirely behind any plane: dot(n, center) + dot(|n|, extent) + w < 0.
+class FrustumCuller {
+    std::vector<float> m_CenterX, m_CenterY, m_CenterZ;
+    std::vector<float> m_ExtentX, m_ExtentY, m_ExtentZ;
+    std::vector<uint8_t> m_Visible;
+    size_t m_Count = 0;
+
+public:
+    void clear() {
+        m_Count = 0;
+        m_CenterX.clear(); m_CenterY.clear(); m_CenterZ.clear();
+        m_ExtentX.clear(); m_ExtentY.clear(); m_ExtentZ.clear();
+    }
+
+    // returns the index of the box in visible(); empty boxes are never culled. Call clear() before adding the next set.
+    size_t add(const Aabb& box) {
+        glm::vec3 center = box.empty() ? glm::vec3(0.0f) : box.center();
+        glm::vec3 extent = box.empty() ? glm::vec3(FLT_MAX) : box.extent();
+        m_CenterX.push_back(center.x); m_CenterY.push_back(center.y); m_CenterZ.push_back(center.z);
+        m_ExtentX.push_back(extent.x); m_ExtentY.push_back(extent.y); m_ExtentZ.push_back(extent.z);
+        return m_Count++;
+    }
+
+    // fills visible(), returns the number of visible boxes
+    size_t cull(const Frustum& frustum) {
+        // pad to a multiple of four with boxes that are always visible, the SIMD loop then needs no tail
+        size_t padded = (m_Count + 3) & ~(size_t)3;
+        for (std::vector<float>* lane : {&m_CenterX, &m_CenterY, &m_CenterZ})
+            lane->resize(padded, 0.0f);
+        for (std::vector<float>* lane : {&m_ExtentX, &m_ExtentY, &m_ExtentZ})
+            lane->resize(padded, FLT_MAX);
+        m_Visible.assign(padded, 1);
+
+#ifdef RG_CULL_SSE
+        const __m128 zero = _mm_setzero_ps();
+        for (size_t i = 0; i < padded; i += 4) {
+            __m128 cx = _mm_loadu_ps(&m_CenterX[i]), cy = _mm_loadu_ps(&m_CenterY[i]), cz = _mm_loadu_ps(&m_CenterZ[i]);
+            __m128 ex = _mm_loadu_ps(&m_ExtentX[i]), ey = _mm_loadu_ps(&m_ExtentY[i]), ez = _mm_loadu_ps(&m_ExtentZ[i]);
+            __m128 outside = _mm_setzero_ps();
+            for (const glm::vec4& plane : frustum.planes) {
+                __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+                __m128 ax = _mm_set1_ps(std::fabs(plane.x)), ay = _mm_set1_ps(std::fabs(plane.y)), az = _mm_set1_ps(std::fabs(plane.z));
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                             _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ex), _mm_mul_ps(ay, ey)), _mm_mul_ps(az, ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+            }
+            int mask = _mm_movemask_ps(outside);
+            for (int lane = 0; lane < 4; ++lane)
+                m_Visible[i + lane] = (uint8_t)!((mask >> lane) & 1);
+        }
+#else
+        for (size_t i = 0; i < padded; ++i) {
+            for (const glm::vec4& plane : frustum.planes) {
+                float distance = plane.x * m_CenterX[i] + plane.y * m_CenterY[i] + plane.z * m_CenterZ[i] + plane.w;
+                float radius = std::fabs(plane.x) * m_ExtentX[i] + std::fabs(plane.y) * m_ExtentY[i] + std::fabs(plane.z) * m_ExtentZ[i];
+                if (distance + radius < 0.0f) {
+                    m_Visible[i] = 0;
+                    break;
+                }
+            }
+        }
+#endif
+        for (std::vector<float>* lane : {&m_CenterX, &m_CenterY, &m_CenterZ, &m_ExtentX, &m_ExtentY, &m_ExtentZ})
+            lane->resize(m_Count);
+        size_t visible = 0;
+        for (size_t i = 0; i < m_Count; ++i)
+            visible += m_Visible[i];
+        return visible;
+    }
+
+    bool visible(size_t index) const { return m_Visible[index] != 0; }
+    size_t size() const { return m_Count; }
+};
+
+}
+#endif //PROJECT_BASE_FRUSTUMCULLING_H
@@ -0,0 +1,164 @@
+#ifndef PROJECT_BASE_GLEXTENSIONS_H
+#define PROJECT_BASE_GLEXTENSIONS_H
+
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <glad/glad.h>
+
+// tokens above the GL 3.3 core profile glad was generated for
+#ifndef GL_TEXTURE_IMMUTABLE_FORMAT
+#define GL_TEXTURE_IMMUTABLE_FORMAT 0x912F
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define GL_PROGRAM_BINARY_FORMATS 0x87FF
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+#define GL_ANY_SAMPLES_PASSED_CONSERVATIVE 0x8D6A
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#define GL_COMPRESSED_SRGB8_ETC2 0x9275
+#endif
+
+namespace rg {
+
+// Optional entry points from newer GL versions and extensions. The window asks for a 3.3 core context, but drivers
+// hand out the newest compatible version, so these are looked up at runtime and every caller keeps a 3.3 path.
+struct GLExtensions {
+    typedef void (APIENTRYP PFNTEXSTORAGE2D)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+    typedef void (APIENTRYP PFNGETPROGRAMBINARY)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void (APIENTRYP PFNPROGRAMBINARY)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+    typedef void (APIENTRYP PFNPROGRAMPARAMETERI)(GLuint program, GLenum pname, GLint value);
+    typedef void (APIENTRYP PFNMAXSHADERCOMPILERTHREADS)(GLuint count);
+    typedef void (APIENTRYP PFNMULTIDRAWELEMENTSINDIRECT)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+    typedef void (APIENTRYP PFNDISPATCHCOMPUTE)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+    typedef void (APIENTRYP PFNMEMORYBARRIER)(GLbitfield barriers);
+    typedef void (APIENTRYP PFNBINDIMAGETEXTURE)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer,
+                                                 GLenum access, GLenum format);
+
+    int major = 3;
+    int minor = 3;
+    std::unordered_set<std::string> extensions;
+
+    PFNTEXSTORAGE2D TexStorage2D = nullptr;
+    PFNGETPROGRAMBINARY GetProgramBinary = nullptr;
+    PFNPROGRAMBINARY ProgramBinary = nullptr;
+    PFNPROGRAMPARAMETERI ProgramParameteri = nullptr;
+    int programBinaryFormats = 0;
+    PFNMAXSHADERCOMPILERTHREADS MaxShaderCompilerThreads = nullptr;
+    bool completionStatus = false;
+    PFNMULTIDRAWELEMENTSINDIRECT MultiDrawElementsIndirect = nullptr;
+    PFNDISPATCHCOMPUTE DispatchCompute = nullptr;
+    PFNMEMORYBARRIER MemoryBarriers = nullptr; // glMemoryBarrier, the plain name is a macro in <windows.h>
+    PFNBINDIMAGETEXTURE BindImageTexture = nullptr;
+
+    bool has(const char* extension) const { return extensions.count(extension) != 0; }
+    bool atLeast(int wantMajor, int wantMinor) const { return major > wantMajor || (major == wantMajor && minor >= wantMinor); }
+
+    bool textureStorage() const { return TexStorage2D != nullptr; }
+    // some drivers expose the entry points but no binary format, which means no binaries in practice
+    bool programBinary() const { return ProgramBinary != nullptr && programBinaryFormats > 0; }
+    // GL_COMPLETION_STATUS_KHR can be polled without waiting for the compiler
+    bool parallelShaderCompile() const { return completionStatus; }
+    bool multiDrawIndirect() const { return MultiDrawElementsIndirect != nullptr; }
+    // compute shaders with storage buffers and image stores, all GL 4.3 core
+    bool computeShaders() const { return DispatchCompute != nullptr && MemoryBarriers != nullptr && BindImageTexture != nullptr; }
+    bool s3tc() const { return has("GL_EXT_texture_compression_s3tc"); }
+    bool bptc() const { return atLeast(4, 2) || has("GL_ARB_texture_compression_bptc"); }
+    bool etc2() const { return atLeast(4, 3) || has("GL_ARB_ES3_compatibility"); }
+
+    // GL 4.x names the core entry point without suffix, the ARB extensions do the same
+    template<typename T>
+    static T lookup(GLADloadproc load, bool available, const char* name) {
+        return available ? (T)load(name) : nullptr;
+    }
+};
+
+// layout of one glMultiDrawElementsIndirect command
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+inline GLExtensions& glextStorage() {
+    static GLExtensions extensions;
+    return extensions;
+}
+
+inline const GLExtensions& glext() {
+    return glextStorage();
+}
+
+// call once after gladLoadGLLoader, with the same loader
+inline void loadGLExtensions(GLADloadproc load) {
+    GLExtensions& ext = glextStorage();
+    glGetIntegerv(GL_MAJOR_VERSION, &ext.major);
+    glGetIntegerv(GL_MINOR_VERSION, &ext.minor);
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+        ext.extensions.insert((const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i));
+
+    ext.TexStorage2D = GLExtensions::lookup<GLExtensions::PFNTEXSTORAGE2D>(
+            load, ext.atLeast(4, 2) || ext.has("GL_ARB_texture_storage"), "glTexStorage2D");
+
+    bool programBinary = ext.atLeast(4, 1) || ext.has("GL_ARB_get_program_binary");
+    ext.GetProgramBinary = GLExtensions::lookup<GLExtensions::PFNGETPROGRAMBINARY>(load, programBinary, "glGetProgramBinary");
+    ext.ProgramBinary = GLExtensions::lookup<GLExtensions::PFNPROGRAMBINARY>(load, programBinary, "glProgramBinary");
+    ext.ProgramParameteri = GLExtensions::lookup<GLExtensions::PFNPROGRAMPARAMETERI>(load, programBinary, "glProgramParameteri");
+    if (programBinary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &ext.programBinaryFormats);
+
+    ext.MultiDrawElementsIndirect = GLExtensions::lookup<GLExtensions::PFNMULTIDRAWELEMENTSINDIRECT>(
+            load, ext.atLeast(4, 3) || ext.has("GL_ARB_multi_draw_indirect"), "glMultiDrawElementsIndirect");
+
+    // the extensions alone leave gaps (GLSL 4.30 storage blocks), so only a 4.3 context counts
+    bool compute = ext.atLeast(4, 3);
+    ext.DispatchCompute = GLExtensions::lookup<GLExtensions::PFNDISPATCHCOMPUTE>(load, compute, "glDispatchCompute");
+    ext.MemoryBarriers = GLExtensions::lookup<GLExtensions::PFNMEMORYBARRIER>(load, compute, "glMemoryBarrier");
+    ext.BindImageTexture = GLExtensions::lookup<GLExtensions::PFNBINDIMAGETEXTURE>(load, compute, "glBindImageTexture");
+
+    // the KHR and ARB versions share the tokens, only the entry point name differs
+    if (ext.has("GL_KHR_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (GLExtensions::PFNMAXSHADERCOMPILERTHREADS)load("glMaxShaderCompilerThreadsKHR");
+    else if (ext.has("GL_ARB_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (GLExtensions::PFNMAXSHADERCOMPILERTHREADS)load("glMaxShaderCompilerThreadsARB");
+    ext.completionStatus = ext.MaxShaderCompilerThreads != nullptr;
+    if (ext.MaxShaderCompilerThreads)
+        ext.MaxShaderCompilerThreads(0xFFFFFFFFu); // let the driver use as many threads as it wants
+}
+
+}
+#endif //PROJECT_BASE_GLEXTENSIONS_H
@@ -0,0 +1,161 @@
+#ifndef PROJECT_BASE_GLSTATE_H
+#define PROJECT_BASE_GLSTATE_H
+
+#include <algorithm>
+#include <glad/glad.h>
+
+namespace rg {
+
+const GLuint kTrackedTextureUnits = 16;
+
+// Shadow copy of the GL state the render loop touches most: bound program, VAO, draw framebuffer, textures per unit,
+// depth func, cull face and the blend/cull/depth test switches. Each setter returns true if it reached GL and counts
+// the calls it dropped, so the effect can be watched per frame.
+//
+// Only changes made through GLState are seen. Code that binds or enables things directly (loading, framebuffer
+// setup, tools drawing on their own) must call invalidate() before the cache is relied on again. ImGui's GL3
+// backend restores what it changes, so the UI needs no invalidate.
+class GLState {
+    static constexpr GLuint kUnknown = 0xFFFFFFFFu;
+
+    enum Capability {
+        Blend,
+        CullFace,
+        DepthTest,
+        CapabilityCount
+    };
+
+    struct Cache {
+        GLuint program;
+        GLuint vertexArray;
+        GLuint framebuffer;
+        GLuint activeUnit;
+        GLuint texture2D[kTrackedTextureUnits];
+        GLuint textureCube[kTrackedTextureUnits];
+        GLuint depthFunc;
+        GLuint cullFace;
+        GLuint enabled[CapabilityCount];
+        unsigned int eliminated;
+        unsigned int eliminatedLastFrame;
+    };
+
+    static Cache& cache() {
+        static Cache state;
+        static bool initialized = (reset(state), true);
+        (void)initialized;
+        return state;
+    }
+
+    static void reset(Cache& state) {
+        state.program = state.vertexArray = state.framebuffer = state.activeUnit = kUnknown;
+        std::fill(state.texture2D, state.texture2D + kTrackedTextureUnits, kUnknown);
+        std::fill(state.textureCube, state.textureCube + kTrackedTextureUnits, kUnknown);
+        state.depthFunc = state.cullFace = kUnknown;
+        std::fill(state.enabled, state.enabled + CapabilityCount, kUnknown);
+    }
+
+    // compares and stores in one go; false (and counted) if the value was already current
+    static bool change(GLuint& current, GLuint value) {
+        if (current == value) {
+            ++cache().eliminated;
+            return false;
+        }
+        current = value;
+        return true;
+    }
+
+    static int capabilityIndex(GLenum capability) {
+        switch (capability) {
+            case GL_BLEND: return Blend;
+            case GL_CULL_FACE: return CullFace;
+            case GL_DEPTH_TEST: return DepthTest;
+            default: return -1;
+        }
+    }
+
+public:
+    static bool useProgram(GLuint program) {
+        if (!change(cache().program, program))
+            return false;
+        glUseProgram(program);
+        return true;
+    }
+
+    static bool bindVertexArray(GLuint vertexArray) {
+        if (!change(cache().vertexArray, vertexArray))
+            return false;
+        glBindVertexArray(vertexArray);
+        return true;
+    }
+
+    // GL_FRAMEBUFFER, i.e. both the draw and the read binding
+    static bool bindFramebuffer(GLuint framebuffer) {
+        if (!change(cache().framebuffer, framebuffer))
+            return false;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        return true;
+    }
+
+    // GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP on the first kTrackedTextureUnits units are tracked, anything else is
+    // passed through (and forgets the active unit)
+    static bool bindTexture(GLuint unit, GLenum target, GLuint texture) {
+        Cache& state = cache();
+        GLuint* bound = nullptr;
+        if (unit < kTrackedTextureUnits && target == GL_TEXTURE_2D)
+            bound = &state.texture2D[unit];
+        else if (unit < kTrackedTextureUnits && target == GL_TEXTURE_CUBE_MAP)
+            bound = &state.textureCube[unit];
+        if (bound && !change(*bound, texture))
+            return false;
+        if (change(state.activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        if (!bound)
+            state.activeUnit = kUnknown;
+        return true;
+    }
+
+    static bool depthFunc(GLenum func) {
+        if (!change(cache().depthFunc, func))
+            return false;
+        glDepthFunc(func);
+        return true;
+    }
+
+    static bool cullFace(GLenum face) {
+        if (!change(cache().cullFace, face))
+            return false;
+        glCullFace(face);
+        return true;
+    }
+
+    // GL_BLEND, GL_CULL_FACE and GL_DEPTH_TEST are tracked, other capabilities are passed through
+    static bool setEnabled(GLenum capability, bool enabled) {
+        int index = capabilityIndex(capability);
+        if (index >= 0 && !change(cache().enabled[index], enabled ? 1u : 0u))
+            return false;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        return true;
+    }
+
+    static void invalidate() {
+        reset(cache());
+    }
+
+    // call once per frame, after the last draw
+    static void endFrame() {
+        cache().eliminatedLastFrame = cache().eliminated;
+        cache().eliminated = 0;
+    }
+
+    // GL calls dropped during the last complete frame
+    static unsigned int eliminatedCalls() {
+        return cache().eliminatedLastFrame;
+    }
+};
+
+}
+#endif //PROJECT_BASE_GLSTATE_H
@@ -0,0 +1,126 @@
+#ifndef PROJECT_BASE_GLTF_H
+#define PROJECT_BASE_GLTF_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <glad/glad.h>
+#include <rg/Json.h>
+#include <rg/MappedFile.h>
+#include <rg/Resources.h>
+
+namespace rg {
+
+// Binary glTF 2.0 container (.glb). The file (or its stored pack entry) stays mapped for the lifetime of the object,
+// and the BIN chunk is exposed in place so buffer views can be handed to the driver without copying.
+class GlbFile {
+    ResourceData m_File;
+    JsonValue m_Json;
+    const unsigned char* m_Bin = nullptr;
+    size_t m_BinSize = 0;
+    std::string m_Error;
+
+    static uint32_t readU32(const unsigned char* p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    bool fail(const std::string& message) {
+        m_Error = message;
+        return false;
+    }
+
+public:
+    static constexpr uint32_t kMagic = 0x46546C67;     // "glTF"
+    static constexpr uint32_t kChunkJson = 0x4E4F534A; // "JSON"
+    static constexpr uint32_t kChunkBin = 0x004E4942;  // "BIN\0"
+
+    bool open(const std::string& path) {
+        if (!Resources::read(path, m_File))
+            return fail("cannot read file");
+        const unsigned char* data = m_File.data;
+        size_t size = m_File.size;
+        if (size < 20 || readU32(data) != kMagic)
+            return fail("not a binary glTF file");
+        if (readU32(data + 4) != 2)
+            return fail("unsupported glTF container version");
+        size = std::min<size_t>(size, readU32(data + 8));
+
+        size_t offset = 12;
+        while (offset + 8 <= size) {
+            uint32_t chunkLength = readU32(data + offset);
+            uint32_t chunkType = readU32(data + offset + 4);
+            offset += 8;
+            if (offset + chunkLength > size)
+                return fail("truncated chunk");
+            const unsigned char* chunk = data + offset;
+            if (chunkType == kChunkJson) {
+                std::string error;
+                m_Json = JsonValue::parse((const char*)chunk, (const char*)chunk + chunkLength, &error);
+                if (!m_Json.isObject())
+                    return fail("invalid JSON chunk: " + error);
+            } else if (chunkType == kChunkBin && !m_Bin) {
+                m_Bin = chunk;
+                m_BinSize = chunkLength;
+            }
+            // chunks are 4 byte aligned
+            offset += (chunkLength + 3u) & ~3u;
+        }
+        if (!m_Json.isObject())
+            return fail("missing JSON chunk");
+        return true;
+    }
+
+    const JsonValue& json() const { return m_Json; }
+    const std::string& error() const { return m_Error; }
+
+    // start of a buffer view inside the BIN chunk, or nullptr if it points anywhere else
+    const unsigned char* bufferViewData(int viewIndex, size_t* length = nullptr) const {
+        const JsonValue& view = m_Json["bufferViews"][viewIndex];
+        if (!view.isObject() || view["buffer"].asInt() != 0 || !m_Bin)
+            return nullptr;
+        size_t offset = (size_t)view["byteOffset"].asInt();
+        size_t byteLength = (size_t)view["byteLength"].asInt();
+        if (offset + byteLength > m_BinSize)
+            return nullptr;
+        if (length)
+            *length = byteLength;
+        return m_Bin + offset;
+    }
+
+    // hints the kernel to fault in the pages of a buffer view before it is uploaded
+    void prefetchBufferView(int viewIndex) const {
+        size_t length = 0;
+        const unsigned char* data = bufferViewData(viewIndex, &length);
+        if (data)
+            adviseWillNeed(data, length);
+    }
+};
+
+// accessor "type" to component count
+inline int gltfComponentCount(const std::string& type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT4") return 16;
+    return 0;
+}
+
+// glTF componentType values are the GL enums, this only validates them
+inline int gltfComponentSize(int componentType) {
+    switch (componentType) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT: return 4;
+        default: return 0;
+    }
+}
+
+}
+#endif //PROJECT_BASE_GLTF_H
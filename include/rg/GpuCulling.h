@@ -0,0 +1,257 @@
+#ifndef PROJECT_BASE_GPUCULLING_H
+#define PROJECT_BASE_GPUCULLING_H
+
+#include <algorithm>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/FrustumCulling.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLState.h>
+#include <rg/ShaderPermutations.h>
+#include <rg/TextureUnits.h>
+
+namespace rg {
+
+// Hierarchical depth of a finished frame: the depth buffer copied into a texture, then reduced level by level into a
+// power of two R32F pyramid whose texels hold the farthest depth below them. GpuCulling tests boxes against it
+// the next frame. GL 4.3 only.
+class DepthPyramid {
+    GLuint m_Depth = 0, m_Pyramid = 0;
+    int m_Width = 0, m_Height = 0;
+    int m_BaseWidth = 0, m_BaseHeight = 0, m_Levels = 0;
+    glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+    bool m_Valid = false;
+
+    static Shader& reduceProgram() {
+        static Shader program = Shader::compute("resources/shaders/depth_pyramid.cs");
+        return program;
+    }
+
+    static int floorPowerOfTwo(int value) {
+        int result = 1;
+        while (result * 2 <= value)
+            result *= 2;
+        return result;
+    }
+
+    void release() {
+        if (m_Depth)
+            glDeleteTextures(1, &m_Depth);
+        if (m_Pyramid)
+            glDeleteTextures(1, &m_Pyramid);
+        m_Depth = m_Pyramid = 0;
+    }
+
+public:
+    DepthPyramid() = default;
+    ~DepthPyramid() { release(); }
+
+    DepthPyramid(const DepthPyramid&) = delete;
+    DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+    // after the opaque draws of a frame, with the framebuffer they went to bound for reading
+    void build(int width, int height, const glm::mat4& viewProjection) {
+        if (width != m_Width || height != m_Height) {
+            release();
+            m_Width = width;
+            m_Height = height;
+            m_BaseWidth = floorPowerOfTwo(width);
+            m_BaseHeight = floorPowerOfTwo(height);
+            m_Levels = 1;
+            while ((m_BaseWidth >> m_Levels) > 0 || (m_BaseHeight >> m_Levels) > 0)
+                ++m_Levels;
+            glGenTextures(1, &m_Depth);
+            glGenTextures(1, &m_Pyramid);
+            GLState::bindTexture(kDepthPyramidUnit, GL_TEXTURE_2D, m_Depth);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            GLState::bindTexture(kDepthPyramidUnit, GL_TEXTURE_2D, m_Pyramid);
+            glext().TexStorage2D(GL_TEXTURE_2D, m_Levels, GL_R32F, m_BaseWidth, m_BaseHeight);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        GLState::bindTexture(kDepthPyramidUnit, GL_TEXTURE_2D, m_Depth);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+        Shader& reduce = reduceProgram();
+        reduce.use();
+        reduce.setInt("source"_u, kDepthPyramidUnit);
+        for (int level = 0; level < m_Levels; ++level) {
+            // level 0 reads the depth copy, every other level the one above it
+            GLState::bindTexture(kDepthPyramidUnit, GL_TEXTURE_2D, level == 0 ? m_Depth : m_Pyramid);
+            reduce.setInt("sourceLevel"_u, level == 0 ? 0 : level - 1);
+            glext().BindImageTexture(0, m_Pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            GLuint levelWidth = (GLuint)std::max(1, m_BaseWidth >> level);
+            GLuint levelHeight = (GLuint)std::max(1, m_BaseHeight >> level);
+            glext().DispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+            glext().MemoryBarriers(GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+        m_ViewProjection = viewProjection;
+        m_Valid = true;
+    }
+
+    // the next build() starts over, e.g. after frames that did not build one
+    void invalidate() { m_Valid = false; }
+
+    bool valid() const { return m_Valid; }
+    GLuint texture() const { return m_Pyramid; }
+    const glm::mat4& viewProjection() const { return m_ViewProjection; }
+};
+
+// Culling and drawing of many copies of one model without the CPU touching the copies per frame. The transforms and
+// world boxes of the instances live in storage buffers; cull() runs a compute shader over them that tests each box
+// against the frustum and the depth pyramid of the last frame and appends the survivors to the model's instance
+// buffer, then a second tiny pass writes their count into one indirect command per mesh. draw() issues those
+// commands with glMultiDrawElementsIndirect, so a frame costs the same few GL calls for ten instances or a million.
+//
+// GL 4.3 only (supported()); without it callers cull the boxes with FrustumCuller and use Model::DrawInstanced.
+// Instances hidden by the pyramid come back one frame late when the camera turns towards them.
+class GpuCulling {
+    Model& m_Model;
+    std::vector<DrawElementsIndirectCommand> m_Commands;
+    GLuint m_Transforms = 0, m_Bounds = 0, m_Counter = 0, m_CommandBuffer = 0;
+    GLsizei m_Instances = 0;
+
+    static Shader& cullProgram() {
+        static Shader program = Shader::compute("resources/shaders/gpu_cull.cs");
+        return program;
+    }
+
+    static Shader& commandProgram() {
+        static Shader program = Shader::compute("resources/shaders/gpu_cull.cs", "#define WRITE_COMMANDS\n");
+        return program;
+    }
+
+    static size_t indexSize(GLenum type) {
+        return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+    }
+
+public:
+    static bool supported() {
+        return glext().computeShaders() && glext().multiDrawIndirect();
+    }
+
+    // the model has to outlive the culler and keep its meshes
+    explicit GpuCulling(Model& model) : m_Model(model) {
+        for (const Mesh& mesh : model.meshes)
+            m_Commands.push_back({(GLuint)mesh.indexCount, 0, (GLuint)(mesh.indexOffset / indexSize(mesh.indexType)),
+                                  mesh.baseVertex, 0});
+        GLuint buffers[4];
+        glGenBuffers(4, buffers);
+        m_Transforms = buffers[0];
+        m_Bounds = buffers[1];
+        m_Counter = buffers[2];
+        m_CommandBuffer = buffers[3];
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Counter);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_CommandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, m_Commands.size() * sizeof(DrawElementsIndirectCommand), m_Commands.data(),
+                     GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    ~GpuCulling() {
+        GLuint buffers[] = {m_Transforms, m_Bounds, m_Counter, m_CommandBuffer};
+        glDeleteBuffers(4, buffers);
+    }
+
+    GpuCulling(const GpuCulling&) = delete;
+    GpuCulling& operator=(const GpuCulling&) = delete;
+
+    // new instance set; the only upload, frames after it send nothing per instance
+    void setInstances(const glm::mat4* transforms, GLsizei count) {
+        Aabb local;
+        for (const Mesh& mesh : m_Model.meshes)
+            local.add(mesh.bounds);
+        std::vector<glm::vec4> bounds;
+        bounds.reserve((size_t)count * 2);
+        for (GLsizei i = 0; i < count; ++i) {
+            Aabb world = transformAabb(local, transforms[i]);
+            if (world.empty()) { // nothing to go by, never culled
+                world.min = glm::vec3(-FLT_MAX);
+                world.max = glm::vec3(FLT_MAX);
+            }
+            bounds.push_back(glm::vec4(world.min, 1.0f));
+            bounds.push_back(glm::vec4(world.max, 1.0f));
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Transforms);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)count * sizeof(glm::mat4), transforms, GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Bounds);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size() * sizeof(glm::vec4), bounds.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        m_Instances = count;
+    }
+
+    // fills the model's instance buffer and the draw commands for this frame; pyramid may be null (or not valid yet)
+    void cull(const Frustum& frustum, const DepthPyramid* pyramid) {
+        if (m_Instances == 0)
+            return;
+        const GLuint zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Counter);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+        // orphaned every frame so the draws of the last one keep their copy, nothing is uploaded
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Model.InstanceBuffer());
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)m_Instances * sizeof(glm::mat4), NULL, GL_STREAM_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_Transforms);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_Bounds);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_Model.InstanceBuffer());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_Counter);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_CommandBuffer);
+
+        Shader& cull = cullProgram();
+        cull.use();
+        cull.setInt("instanceCount"_u, m_Instances);
+        glUniform4fv(cull.location("frustumPlanes"_u), 6, &frustum.planes[0][0]);
+        bool occlusion = pyramid != nullptr && pyramid->valid();
+        cull.setBool("occlusion"_u, occlusion);
+        if (occlusion) {
+            GLState::bindTexture(kDepthPyramidUnit, GL_TEXTURE_2D, pyramid->texture());
+            cull.setInt("depthPyramid"_u, kDepthPyramidUnit);
+            cull.setMat4("pyramidViewProjection"_u, pyramid->viewProjection());
+        }
+        glext().DispatchCompute(((GLuint)m_Instances + 63) / 64, 1, 1);
+        glext().MemoryBarriers(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        Shader& commands = commandProgram();
+        commands.use();
+        commands.setInt("commandCount"_u, (GLint)m_Commands.size());
+        glext().DispatchCompute(((GLuint)m_Commands.size() + 63) / 64, 1, 1);
+        glext().MemoryBarriers(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    }
+
+    // draws what cull() kept, runs of meshes sharing material and VAO in one multi-draw
+    void draw(ShaderPermutations& variants, uint32_t frameFeatures) {
+        if (m_Instances == 0)
+            return;
+        std::vector<Mesh>& meshes = m_Model.meshes;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+        for (size_t first = 0; first < meshes.size();) {
+            Mesh& mesh = meshes[first];
+            Shader* variant;
+            variants.use(frameFeatures | FeatureInstanced | mesh.MaterialFeatures(), variant);
+            GLuint vertexArray = mesh.VertexArrayFor(*variant);
+            size_t end = first + 1;
+            while (end < meshes.size() && meshes[end].SameMaterial(mesh) && meshes[end].indexType == mesh.indexType &&
+                   meshes[end].VertexArrayFor(*variant) == vertexArray)
+                ++end;
+            mesh.BindMaterial(*variant);
+            GLState::bindVertexArray(vertexArray);
+            glext().MultiDrawElementsIndirect(GL_TRIANGLES, mesh.indexType,
+                                              (const void*)(first * sizeof(DrawElementsIndirectCommand)),
+                                              (GLsizei)(end - first), 0);
+            first = end;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    GLsizei instances() const { return m_Instances; }
+};
+
+}
+#endif //PROJECT_BASE_GPUCULLING_H
@@ -0,0 +1,25 @@
+#ifndef PROJECT_BASE_HASH_H
+#define PROJECT_BASE_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace rg {
+
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+// 64 bit FNV-1a. constexpr so names can be hashed at compile time; chain calls by passing the previous hash as seed.
+constexpr uint64_t fnv1a(const char* data, size_t size, uint64_t hash = kFnvOffset) {
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ (uint64_t)(unsigned char)data[i]) * kFnvPrime;
+    return hash;
+}
+
+inline uint64_t fnv1a(const std::string& text, uint64_t hash = kFnvOffset) {
+    return fnv1a(text.data(), text.size(), hash);
+}
+
+}
+#endif //PROJECT_BASE_HASH_H
@@ -0,0 +1,278 @@
+#ifndef PROJECT_BASE_JSON_H
+#define PROJECT_BASE_JSON_H
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+// Minimal read-only JSON document, enough for glTF headers and the scene files.
+// Missing keys and out of range indices resolve to a shared null value, so lookups can be chained.
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    bool isNull() const { return type == Type::Null; }
+    bool isNumber() const { return type == Type::Number; }
+    bool isString() const { return type == Type::String; }
+    bool isArray() const { return type == Type::Array; }
+    bool isObject() const { return type == Type::Object; }
+
+    size_t size() const {
+        return type == Type::Array ? array.size() : (type == Type::Object ? object.size() : 0);
+    }
+
+    bool has(const char* key) const {
+        return !(*this)[key].isNull();
+    }
+
+    const JsonValue& operator[](const char* key) const {
+        if (type == Type::Object) {
+            for (const auto& member : object) {
+                if (member.first == key)
+                    return member.second;
+            }
+        }
+        return null();
+    }
+
+    // any integer type, so that literal 0 does not resolve to the key overload
+    template<typename Index, typename = typename std::enable_if<std::is_integral<Index>::value>::type>
+    const JsonValue& operator[](Index index) const {
+        if (type == Type::Array && index >= 0 && (size_t)index < array.size())
+            return array[(size_t)index];
+        return null();
+    }
+
+    int asInt(int def = 0) const { return type == Type::Number ? (int)number : def; }
+    float asFloat(float def = 0.0f) const { return type == Type::Number ? (float)number : def; }
+    bool asBool(bool def = false) const { return type == Type::Bool ? boolean : def; }
+    const std::string& asString() const { return string; }
+
+    static const JsonValue& null() {
+        static const JsonValue value;
+        return value;
+    }
+
+    // parses [begin, end); on failure returns a null value and fills error
+    static JsonValue parse(const char* begin, const char* end, std::string* error = nullptr) {
+        Parser parser{begin, end, std::string()};
+        JsonValue value;
+        if (!parser.parseValue(value, 0) || (parser.skipWhitespace(), parser.p != parser.end && *parser.p != '\0')) {
+            if (error)
+                *error = parser.error.empty() ? "unexpected trailing characters" : parser.error;
+            return JsonValue();
+        }
+        return value;
+    }
+
+private:
+    struct Parser {
+        const char* p;
+        const char* end;
+        std::string error;
+
+        static constexpr int kMaxDepth = 128;
+
+        bool fail(const char* message) {
+            error = message;
+            return false;
+        }
+
+        void skipWhitespace() {
+            while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+                ++p;
+        }
+
+        bool consume(const char* literal) {
+            size_t length = std::strlen(literal);
+            if ((size_t)(end - p) < length || std::strncmp(p, literal, length) != 0)
+                return false;
+            p += length;
+            return true;
+        }
+
+        bool parseValue(JsonValue& out, int depth) {
+            if (depth > kMaxDepth)
+                return fail("nesting too deep");
+            skipWhitespace();
+            if (p == end)
+                return fail("unexpected end of input");
+            switch (*p) {
+                case '{': return parseObject(out, depth);
+                case '[': return parseArray(out, depth);
+                case '"': out.type = Type::String; return parseString(out.string);
+                case 't': out.type = Type::Bool; out.boolean = true; return consume("true") || fail("invalid literal");
+                case 'f': out.type = Type::Bool; out.boolean = false; return consume("false") || fail("invalid literal");
+                case 'n': out.type = Type::Null; return consume("null") || fail("invalid literal");
+                default: return parseNumber(out);
+            }
+        }
+
+        bool parseNumber(JsonValue& out) {
+            // strtod needs a terminated buffer, numbers are short so copy them out
+            char buffer[64];
+            size_t length = 0;
+            while (p + length != end && length < sizeof(buffer) - 1 && p[length] != '\0' && std::strchr("+-0123456789.eE", p[length]))
+                ++length;
+            if (length == 0)
+                return fail("unexpected character");
+            std::memcpy(buffer, p, length);
+            buffer[length] = '\0';
+            char* parsedEnd = nullptr;
+            out.type = Type::Number;
+            out.number = std::strtod(buffer, &parsedEnd);
+            if (parsedEnd != buffer + length)
+                return fail("invalid number");
+            p += length;
+            return true;
+        }
+
+        static void appendUtf8(std::string& out, unsigned codepoint) {
+            if (codepoint < 0x80) {
+                out += (char)codepoint;
+            } else if (codepoint < 0x800) {
+                out += (char)(0xC0 | (codepoint >> 6));
+                out += (char)(0x80 | (codepoint & 0x3F));
+            } else if (codepoint < 0x10000) {
+                out += (char)(0xE0 | (codepoint >> 12));
+                out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+                out += (char)(0x80 | (codepoint & 0x3F));
+            } else {
+                out += (char)(0xF0 | (codepoint >> 18));
+                out += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+                out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+                out += (char)(0x80 | (codepoint & 0x3F));
+            }
+        }
+
+        bool parseHex4(unsigned& value) {
+            if (end - p < 4)
+                return fail("truncated escape");
+            value = 0;
+            for (int i = 0; i < 4; ++i, ++p) {
+                char c = *p;
+                value <<= 4;
+                if (c >= '0' && c <= '9') value |= (unsigned)(c - '0');
+                else if (c >= 'a' && c <= 'f') value |= (unsigned)(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F') value |= (unsigned)(c - 'A' + 10);
+                else return fail("invalid escape");
+            }
+            return true;
+        }
+
+        bool parseString(std::string& out) {
+            ++p; // opening quote
+            while (p != end && *p != '"') {
+                if (*p != '\\') {
+                    out += *p++;
+                    continue;
+                }
+                if (++p == end)
+                    return fail("truncated escape");
+                char c = *p++;
+                switch (c) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        unsigned codepoint;
+                        if (!parseHex4(codepoint))
+                            return false;
+                        if (codepoint >= 0xD800 && codepoint < 0xDC00 && consume("\\u")) {
+                            unsigned low;
+                            if (!parseHex4(low))
+                                return false;
+                            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendUtf8(out, codepoint);
+                        break;
+                    }
+                    default: return fail("invalid escape");
+                }
+            }
+            if (p == end)
+                return fail("unterminated string");
+            ++p; // closing quote
+            return true;
+        }
+
+        bool parseArray(JsonValue& out, int depth) {
+            out.type = Type::Array;
+            ++p;
+            skipWhitespace();
+            if (p != end && *p == ']') {
+                ++p;
+                return true;
+            }
+            while (true) {
+                out.array.emplace_back();
+                if (!parseValue(out.array.back(), depth + 1))
+                    return false;
+                skipWhitespace();
+                if (p != end && *p == ',') {
+                    ++p;
+                    continue;
+                }
+                if (p != end && *p == ']') {
+                    ++p;
+                    return true;
+                }
+                return fail("expected ',' or ']'");
+            }
+        }
+
+        bool parseObject(JsonValue& out, int depth) {
+            out.type = Type::Object;
+            ++p;
+            skipWhitespace();
+            if (p != end && *p == '}') {
+                ++p;
+                return true;
+            }
+            while (true) {
+                skipWhitespace();
+                if (p == end || *p != '"')
+                    return fail("expected key");
+                out.object.emplace_back();
+                if (!parseString(out.object.back().first))
+                    return false;
+                skipWhitespace();
+                if (p == end || *p != ':')
+                    return fail("expected ':'");
+                ++p;
+                if (!parseValue(out.object.back().second, depth + 1))
+                    return false;
+                skipWhitespace();
+                if (p != end && *p == ',') {
+                    ++p;
+                    continue;
+                }
+                if (p != end && *p == '}') {
+                    ++p;
+                    return true;
+                }
+                return fail("expected ',' or '}'");
+            }
+        }
+    };
+};
+
+}
+#endif //PROJECT_BASE_JSON_H
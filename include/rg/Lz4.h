@@ -0,0 +1,168 @@
+#ifndef PROJECT_BASE_LZ4_H
+#define PROJECT_BASE_LZ4_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace rg {
+namespace lz4 {
+
+// LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), so packs can be inspected
+// with the reference tools. The compressor is a plain greedy single-probe matcher, good enough for an offline packer.
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;   // the block must end with at least this many literals
+constexpr size_t kMatchSafeLimit = 12; // no match may start in the last 12 bytes
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashLog = 16;
+
+inline size_t compressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+namespace detail {
+    inline uint32_t read32(const unsigned char* p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t hash(uint32_t sequence) {
+        return (sequence * 2654435761u) >> (32 - kHashLog);
+    }
+
+    inline bool writeLength(unsigned char*& op, const unsigned char* end, size_t length) {
+        while (length >= 255) {
+            if (op == end)
+                return false;
+            *op++ = 255;
+            length -= 255;
+        }
+        if (op == end)
+            return false;
+        *op++ = (unsigned char)length;
+        return true;
+    }
+
+    // one sequence: literals [literals, literals + literalLength) followed by an optional match
+    inline bool writeSequence(unsigned char*& op, const unsigned char* end, const unsigned char* literals, size_t literalLength,
+                              size_t offset, size_t matchLength) {
+        if (op == end)
+            return false;
+        unsigned char* token = op++;
+        *token = (unsigned char)((literalLength < 15 ? literalLength : 15) << 4);
+        if (literalLength >= 15 && !writeLength(op, end, literalLength - 15))
+            return false;
+        if ((size_t)(end - op) < literalLength)
+            return false;
+        if (literalLength)
+            std::memcpy(op, literals, literalLength);
+        op += literalLength;
+        if (matchLength == 0)
+            return true;
+        if (end - op < 2)
+            return false;
+        *op++ = (unsigned char)(offset & 0xFF);
+        *op++ = (unsigned char)(offset >> 8);
+        size_t code = matchLength - kMinMatch;
+        *token |= (unsigned char)(code < 15 ? code : 15);
+        return code < 15 || writeLength(op, end, code - 15);
+    }
+}
+
+// returns the compressed size, or 0 if it does not fit into dstCapacity
+inline size_t compress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstCapacity) {
+    unsigned char* op = dst;
+    const unsigned char* end = dst + dstCapacity;
+    size_t anchor = 0;
+    if (srcSize > kMatchSafeLimit) {
+        std::vector<uint32_t> table((size_t)1 << kHashLog, 0);
+        size_t limit = srcSize - kMatchSafeLimit;
+        size_t matchLimit = srcSize - kLastLiterals;
+        size_t ip = 0;
+        while (ip < limit) {
+            uint32_t sequence = detail::read32(src + ip);
+            uint32_t h = detail::hash(sequence);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+            if (ref >= ip || ip - ref > kMaxOffset || detail::read32(src + ref) != sequence) {
+                ++ip;
+                continue;
+            }
+            size_t matchEnd = ip + kMinMatch;
+            while (matchEnd < matchLimit && src[matchEnd] == src[ref + (matchEnd - ip)])
+                ++matchEnd;
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                --ip;
+                --ref;
+            }
+            if (!detail::writeSequence(op, end, src + anchor, ip - anchor, ip - ref, matchEnd - ip))
+                return 0;
+            ip = matchEnd;
+            anchor = ip;
+        }
+    }
+    if (!detail::writeSequence(op, end, src + anchor, srcSize - anchor, 0, 0))
+        return 0;
+    return (size_t)(op - dst);
+}
+
+// dstSize must be the exact decompressed size; fails on any malformed or truncated input
+inline bool decompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize) {
+    const unsigned char* ip = src;
+    const unsigned char* srcEnd = src + srcSize;
+    unsigned char* op = dst;
+    unsigned char* dstEnd = dst + dstSize;
+    while (ip < srcEnd) {
+        unsigned token = *ip++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15) {
+            unsigned char b;
+            do {
+                if (ip == srcEnd)
+                    return false;
+                b = *ip++;
+                literalLength += b;
+            } while (b == 255);
+        }
+        if ((size_t)(srcEnd - ip) < literalLength || (size_t)(dstEnd - op) < literalLength)
+            return false;
+        if (literalLength)
+            std::memcpy(op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+        if (ip == srcEnd)
+            break; // the last sequence has no match
+        if (srcEnd - ip < 2)
+            return false;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst))
+            return false;
+        size_t matchLength = token & 15;
+        if (matchLength == 15) {
+            unsigned char b;
+            do {
+                if (ip == srcEnd)
+                    return false;
+                b = *ip++;
+                matchLength += b;
+            } while (b == 255);
+        }
+        matchLength += kMinMatch;
+        if ((size_t)(dstEnd - op) < matchLength)
+            return false;
+        // the match may overlap the bytes it produces, so copy forward one byte at a time
+        const unsigned char* match = op - offset;
+        for (size_t i = 0; i < matchLength; ++i)
+            op[i] = match[i];
+        op += matchLength;
+    }
+    return op == dstEnd;
+}
+
+}
+}
+#endif //PROJECT_BASE_LZ4_H
@@ -0,0 +1,92 @@
+#ifndef PROJECT_BASE_MAPPEDFILE_H
+#define PROJECT_BASE_MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rg {
+
+// tells the kernel we are about to read the range front to back
+inline void adviseWillNeed(const void* data, size_t length) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)data / page * page;
+    madvise((void*)begin, (uintptr_t)data + length - begin, MADV_WILLNEED);
+}
+
+// Read-only memory mapping of a whole file. The mapping is released when the object goes out of scope,
+// so pointers into data() must not outlive it.
+class MappedFile {
+    const unsigned char* m_Data = nullptr;
+    size_t m_Size = 0;
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& path) {
+        open(path);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept : m_Data(other.m_Data), m_Size(other.m_Size) {
+        other.m_Data = nullptr;
+        other.m_Size = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            m_Data = other.m_Data;
+            m_Size = other.m_Size;
+            other.m_Data = nullptr;
+            other.m_Size = 0;
+        }
+        return *this;
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps its own reference to the file
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        m_Data = static_cast<const unsigned char*>(data);
+        m_Size = (size_t)st.st_size;
+        return true;
+    }
+
+    void close() {
+        if (m_Data) {
+            munmap(const_cast<unsigned char*>(m_Data), m_Size);
+        }
+        m_Data = nullptr;
+        m_Size = 0;
+    }
+
+    bool isOpen() const { return m_Data != nullptr; }
+    const unsigned char* data() const { return m_Data; }
+    size_t size() const { return m_Size; }
+};
+
+}
+#endif //PROJECT_BASE_MAPPEDFILE_H
@@ -0,0 +1,176 @@
+#ifndef PROJECT_BASE_MESHLETS_H
+#define PROJECT_BASE_MESHLETS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+#include <rg/FrustumCulling.h>
+
+namespace rg {
+
+// Cluster of neighbouring triangles, a contiguous range of its mesh's indices. The normals of its triangles lie
+// within a cone around coneAxis; coneCutoff is the sine of the cone's half angle, 1 if the cone is too wide to
+// ever face away as a whole.
+struct Meshlet {
+    uint32_t firstIndex; // into the mesh's indices, not counting the mesh's own offset
+    uint32_t indexCount;
+    Sphere sphere;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// index range of the mesh, what culling hands to the render queue
+struct IndexRange {
+    uint32_t first;
+    uint32_t count;
+};
+
+const uint32_t kMeshletTriangles = 128;
+// meshes with fewer triangles are drawn whole, the per cluster tests would cost more than they save
+const uint32_t kMeshletMinTriangles = 4 * kMeshletTriangles;
+
+// Splits the triangles into meshlets and reorders indices so that every meshlet is one range. Clusters grow from a
+// seed triangle over shared vertices, taking only triangles whose normal is within 60 degrees of the seed's, which
+// keeps the cones narrow enough to be culled from behind. Returns nothing (and leaves indices alone) for small or
+// non triangle meshes.
+inline std::vector<Meshlet> buildMeshlets(const std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices) {
+    std::vector<Meshlet> meshlets;
+    size_t triangles = indices.size() / 3;
+    if (indices.size() % 3 != 0 || triangles < kMeshletMinTriangles)
+        return meshlets;
+
+    std::vector<glm::vec3> normals(triangles);
+    for (size_t t = 0; t < triangles; ++t) {
+        const glm::vec3& a = positions[indices[3 * t]];
+        glm::vec3 normal = glm::cross(positions[indices[3 * t + 1]] - a, positions[indices[3 * t + 2]] - a);
+        float length = glm::length(normal);
+        normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    }
+    // triangles around each vertex, compressed rows
+    std::vector<uint32_t> rowStart(positions.size() + 1, 0), vertexTriangles(indices.size());
+    for (unsigned int index : indices)
+        ++rowStart[index + 1];
+    for (size_t v = 0; v < positions.size(); ++v)
+        rowStart[v + 1] += rowStart[v];
+    std::vector<uint32_t> fill(rowStart.begin(), rowStart.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        vertexTriangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+    const float kGrowLimit = 0.5f; // cos 60
+    std::vector<uint8_t> used(triangles, 0);
+    std::vector<uint32_t> queued(triangles, UINT32_MAX); // meshlet that last queued the triangle
+    std::vector<uint32_t> frontier, members;
+    std::vector<unsigned int> reordered;
+    reordered.reserve(indices.size());
+    for (size_t seed = 0; seed < triangles; ++seed) {
+        if (used[seed])
+            continue;
+        uint32_t id = (uint32_t)meshlets.size();
+        glm::vec3 seedNormal = normals[seed];
+        members.clear();
+        frontier.assign(1, (uint32_t)seed);
+        queued[seed] = id;
+        for (size_t next = 0; next < frontier.size() && members.size() < kMeshletTriangles; ++next) {
+            uint32_t t = frontier[next];
+            // degenerate triangles have no normal and go with any cluster
+            if (used[t] || (normals[t] != glm::vec3(0.0f) && seedNormal != glm::vec3(0.0f) &&
+                            glm::dot(normals[t], seedNormal) < kGrowLimit))
+                continue;
+            used[t] = 1;
+            members.push_back(t);
+            for (int corner = 0; corner < 3; ++corner) {
+                unsigned int vertex = indices[3 * t + corner];
+                for (uint32_t k = rowStart[vertex]; k < rowStart[vertex + 1]; ++k) {
+                    uint32_t neighbour = vertexTriangles[k];
+                    if (!used[neighbour] && queued[neighbour] != id) {
+                        queued[neighbour] = id;
+                        frontier.push_back(neighbour);
+                    }
+                }
+            }
+        }
+
+        Meshlet meshlet;
+        meshlet.firstIndex = (uint32_t)reordered.size();
+        meshlet.indexCount = (uint32_t)members.size() * 3;
+        Aabb box;
+        glm::vec3 axis(0.0f);
+        for (uint32_t t : members) {
+            for (int corner = 0; corner < 3; ++corner) {
+                reordered.push_back(indices[3 * t + corner]);
+                box.add(positions[indices[3 * t + corner]]);
+            }
+            axis += normals[t];
+        }
+        meshlet.sphere.center = box.center();
+        meshlet.sphere.radius = 0.0f;
+        for (size_t i = meshlet.firstIndex; i < reordered.size(); ++i)
+            meshlet.sphere.radius = std::max(meshlet.sphere.radius, glm::length(positions[reordered[i]] - meshlet.sphere.center));
+        float axisLength = glm::length(axis);
+        meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+        for (uint32_t t : members) {
+            if (normals[t] != glm::vec3(0.0f))
+                minDot = std::min(minDot, glm::dot(normals[t], meshlet.coneAxis));
+        }
+        meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+        meshlets.push_back(meshlet);
+    }
+    indices.swap(reordered);
+    return meshlets;
+}
+
+// Appends the index ranges of the meshlets that may be seen to ranges, neighbouring ones merged into one range. A
+// meshlet is kept if its sphere is in at least one of the frustums and, unless its cone is too wide, it has a
+// triangle facing eye: it can only be dropped if dot(center - eye, axis) > cutoff * |center - eye| + radius *
+// (1 + cutoff), i.e. every point of the sphere sees every normal of the cone from behind. The cone test needs the
+// transform to keep angles (rotation, translation, uniform scale); otherwise it is skipped.
+inline size_t cullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& transform, const Frustum* frustums,
+                           int frustumCount, const glm::vec3& eye, std::vector<IndexRange>& ranges) {
+    glm::vec3 columns[3] = {glm::vec3(transform[0]), glm::vec3(transform[1]), glm::vec3(transform[2])};
+    float scale = glm::length(columns[0]);
+    bool keepsAngles = scale > 0.0f &&
+                       std::fabs(glm::length(columns[1]) - scale) <= 1e-3f * scale &&
+                       std::fabs(glm::length(columns[2]) - scale) <= 1e-3f * scale &&
+                       std::fabs(glm::dot(columns[0], columns[1])) <= 1e-3f * scale * scale &&
+                       std::fabs(glm::dot(columns[1], columns[2])) <= 1e-3f * scale * scale &&
+                       std::fabs(glm::dot(columns[2], columns[0])) <= 1e-3f * scale * scale;
+    bool mirrored = glm::dot(glm::cross(columns[0], columns[1]), columns[2]) < 0.0f;
+    size_t kept = 0;
+    for (const Meshlet& meshlet : meshlets) {
+        glm::vec3 center = glm::vec3(transform * glm::vec4(meshlet.sphere.center, 1.0f));
+        float radius = meshlet.sphere.radius * scale;
+        bool inFrustum = frustumCount == 0;
+        for (int f = 0; f < frustumCount && !inFrustum; ++f) {
+            inFrustum = true;
+            for (const glm::vec4& plane : frustums[f].planes) {
+                if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                    inFrustum = false;
+                    break;
+                }
+            }
+        }
+        if (!inFrustum)
+            continue;
+        if (keepsAngles && meshlet.coneCutoff < 1.0f) {
+            // a mirroring transform flips the winding, the front faces then point against the normals
+            glm::vec3 axis = (mirrored ? -1.0f : 1.0f) * (columns[0] * meshlet.coneAxis.x + columns[1] * meshlet.coneAxis.y +
+                                                          columns[2] * meshlet.coneAxis.z) / scale;
+            glm::vec3 view = center - eye;
+            if (glm::dot(view, axis) > meshlet.coneCutoff * glm::length(view) + radius * (1.0f + meshlet.coneCutoff))
+                continue;
+        }
+        ++kept;
+        if (!ranges.empty() && ranges.back().first + ranges.back().count == meshlet.firstIndex)
+            ranges.back().count += meshlet.indexCount;
+        else
+            ranges.push_back({meshlet.firstIndex, meshlet.indexCount});
+    }
+    return kept;
+}
+
+}
+#endif //PROJECT_BASE_MESHLETS_H
@@ -0,0 +1,160 @@
+#ifndef PROJECT_BASE_OCCLUSIONQUERIES_H
+#define PROJECT_BASE_OCCLUSIONQUERIES_H
+
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLState.h>
+
+namespace rg {
+
+// Hardware occlusion culling with results read a frame late. After the opaque geometry of a frame is drawn, issue()
+// draws the bounding box of every object in view into one query each, with color and depth writes off. The next
+// frame's collect() picks up the results that are ready without waiting for the rest, and visible() tells the
+// scene which objects to leave out. An object is drawn again one frame after its box shows up, and every object the
+// GPU has not answered for yet keeps its last state.
+//
+// Uses GL_ANY_SAMPLES_PASSED_CONSERVATIVE where available (GL 4.3, ARB_ES3_compatibility), which lets the driver
+// answer early from coarse depth, and GL_ANY_SAMPLES_PASSED otherwise.
+class OcclusionQueries {
+    struct Entry {
+        GLuint query = 0;
+        bool pending = false;
+        bool visible = true;
+    };
+
+    std::vector<Entry> m_Entries;
+    GLuint m_VAO = 0, m_VBO = 0, m_EBO = 0;
+    GLenum m_Target = GL_ANY_SAMPLES_PASSED;
+    size_t m_Occluded = 0;
+
+    static bool contains(const Aabb& box, const glm::vec3& point, float margin) {
+        for (int axis = 0; axis < 3; ++axis) {
+            if (point[axis] < box.min[axis] - margin || point[axis] > box.max[axis] + margin)
+                return false;
+        }
+        return true;
+    }
+
+public:
+    OcclusionQueries() {
+        if (glext().atLeast(4, 3) || glext().has("GL_ARB_ES3_compatibility"))
+            m_Target = GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+        // unit cube, the proxy shader stretches it to the box
+        const float corners[] = {
+                0, 0, 0,  1, 0, 0,  1, 1, 0,  0, 1, 0,
+                0, 0, 1,  1, 0, 1,  1, 1, 1,  0, 1, 1,
+        };
+        const unsigned char faces[] = {
+                0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,
+                3, 6, 2, 3, 7, 6,  0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5,
+        };
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_VBO);
+        glGenBuffers(1, &m_EBO);
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
+    }
+
+    ~OcclusionQueries() {
+        for (Entry& entry : m_Entries) {
+            if (entry.query)
+                glDeleteQueries(1, &entry.query);
+        }
+        glDeleteVertexArrays(1, &m_VAO);
+        glDeleteBuffers(1, &m_VBO);
+        glDeleteBuffers(1, &m_EBO);
+    }
+
+    OcclusionQueries(const OcclusionQueries&) = delete;
+    OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+    // start of the frame: adopt the results the GPU has finished, never waits
+    void collect(size_t objects) {
+        if (m_Entries.size() != objects) {
+            for (size_t i = objects; i < m_Entries.size(); ++i) {
+                if (m_Entries[i].query)
+                    glDeleteQueries(1, &m_Entries[i].query);
+            }
+            m_Entries.resize(objects);
+        }
+        m_Occluded = 0;
+        for (Entry& entry : m_Entries) {
+            if (entry.pending) {
+                GLuint available = 0;
+                glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available) {
+                    GLuint samples = 0;
+                    glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT, &samples);
+                    entry.visible = samples != 0;
+                    entry.pending = false;
+                }
+            }
+            m_Occluded += entry.visible ? 0 : 1;
+        }
+    }
+
+    // forget every result, for when the objects were renumbered (e.g. renderables removed by the streaming); the
+    // queries still in flight are reused by the next issue()
+    void reset() {
+        for (Entry& entry : m_Entries) {
+            entry.pending = false;
+            entry.visible = true;
+        }
+        m_Occluded = 0;
+    }
+
+    bool visible(size_t object) const {
+        return object >= m_Entries.size() || m_Entries[object].visible;
+    }
+
+    // objects collect() found hidden this frame
+    size_t occluded() const { return m_Occluded; }
+
+    // after the opaque pass: queries the box of every object in view against the depth buffer. Objects out of view
+    // are reset to visible, so they never come back into view already hidden; so are objects whose box contains
+    // the camera, as the near plane would clip away the faces in front of it.
+    void issue(Shader& proxy, const std::vector<Aabb>& bounds, const std::vector<uint8_t>& inView,
+               const glm::vec3& eye, float nearPlane) {
+        proxy.use();
+        GLint boxMin = proxy.location("boxMin"), boxMax = proxy.location("boxMax");
+        GLState::bindVertexArray(m_VAO);
+        GLState::setEnabled(GL_CULL_FACE, false);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        for (size_t i = 0; i < m_Entries.size() && i < bounds.size(); ++i) {
+            Entry& entry = m_Entries[i];
+            const Aabb& box = bounds[i];
+            if (!inView[i] || box.empty() || contains(box, eye, nearPlane)) {
+                entry.visible = true;
+                continue;
+            }
+            if (entry.pending)
+                continue; // still waiting for the last one, it will be collected later
+            if (!entry.query)
+                glGenQueries(1, &entry.query);
+            proxy.setVec3(boxMin, box.min);
+            proxy.setVec3(boxMax, box.max);
+            glBeginQuery(m_Target, entry.query);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0);
+            glEndQuery(m_Target);
+            entry.pending = true;
+        }
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        GLState::setEnabled(GL_CULL_FACE, true);
+    }
+};
+
+}
+#endif //PROJECT_BASE_OCCLUSIONQUERIES_H
@@ -0,0 +1,148 @@
+#ifndef PROJECT_BASE_PROGRAMCACHE_H
+#define PROJECT_BASE_PROGRAMCACHE_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <glad/glad.h>
+#include <rg/GLExtensions.h>
+#include <rg/Hash.h>
+#include <rg/MappedFile.h>
+
+namespace rg {
+
+// On disk cache of linked program binaries, one file per program named after its key:
+//
+//   u32 magic "RGPB", u32 version, u64 key, u32 binary format, u32 binary length, binary
+//
+// Binaries are only valid for the driver that produced them, so the key covers the GL vendor, renderer and version
+// strings next to the shader sources and defines. A binary the driver refuses anyway (driver update with the same
+// version string, corrupt file) is deleted and the program is compiled from source again.
+class ProgramCache {
+    static constexpr uint32_t kMagic = 0x42504752; // "RGPB"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kHeaderSize = 24;
+
+    static std::string& directoryStorage() {
+        static std::string directory = ".shader_cache";
+        return directory;
+    }
+
+    static std::string pathFor(uint64_t key) {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return directoryStorage() + "/" + name + ".bin";
+    }
+
+public:
+    static void setDirectory(const std::string& directory) { directoryStorage() = directory; }
+
+    static bool enabled() { return glext().programBinary(); }
+
+    // sources in stage order; defines are whatever the caller injected into them, hashed separately so
+    // two permutations of one file never share an entry
+    static uint64_t key(const std::vector<std::string>& sources, const std::string& defines) {
+        uint64_t hash = kFnvOffset;
+        const GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+        for (GLenum name : strings) {
+            const char* value = (const char*)glGetString(name);
+            hash = fnv1a(std::string(value ? value : ""), hash);
+            hash = fnv1a("\n", 1, hash);
+        }
+        hash = fnv1a(defines, hash);
+        for (const std::string& source : sources) {
+            // the length keeps "ab"+"c" and "a"+"bc" apart
+            uint64_t length = source.size();
+            hash = fnv1a((const char*)&length, sizeof(length), hash);
+            hash = fnv1a(source, hash);
+        }
+        return hash;
+    }
+
+    // loads the cached binary into program, true if it linked
+    static bool load(GLuint program, uint64_t key) {
+        if (!enabled())
+            return false;
+        std::string path = pathFor(key);
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return false;
+        MappedFile file;
+        if (!file.open(path) || file.size() < kHeaderSize) {
+            std::remove(path.c_str());
+            return false;
+        }
+        uint32_t header[2], format, length;
+        uint64_t storedKey;
+        std::memcpy(header, file.data(), 8);
+        std::memcpy(&storedKey, file.data() + 8, 8);
+        std::memcpy(&format, file.data() + 16, 4);
+        std::memcpy(&length, file.data() + 20, 4);
+        if (header[0] != kMagic || header[1] != kVersion || storedKey != key || kHeaderSize + length > file.size()) {
+            std::remove(path.c_str());
+            return false;
+        }
+        glext().ProgramBinary(program, format, file.data() + kHeaderSize, (GLsizei)length);
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            std::remove(path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // call before glLinkProgram on programs that will be stored, some drivers only keep a binary when asked to
+    static void prepare(GLuint program) {
+        if (enabled())
+            glext().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes the binary of a linked program; written to a temporary file first so a crash never leaves a torn entry
+    static void store(GLuint program, uint64_t key) {
+        if (!enabled())
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary((size_t)length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glext().GetProgramBinary(program, length, &written, &format, binary.data());
+        if (written <= 0)
+            return;
+
+        if (mkdir(directoryStorage().c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cout << "ERROR::PROGRAM_CACHE:: cannot create " << directoryStorage() << std::endl;
+            return;
+        }
+        std::string path = pathFor(key);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            uint32_t header[2] = {kMagic, kVersion};
+            uint32_t format32 = format, length32 = (uint32_t)written;
+            out.write((const char*)header, sizeof(header));
+            out.write((const char*)&key, sizeof(key));
+            out.write((const char*)&format32, sizeof(format32));
+            out.write((const char*)&length32, sizeof(length32));
+            out.write(binary.data(), written);
+            if (!out) {
+                std::remove(temporary.c_str());
+                return;
+            }
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0)
+            std::remove(temporary.c_str());
+    }
+};
+
+}
+#endif //PROJECT_BASE_PROGRAMCACHE_H
@@ -0,0 +1,233 @@
+#ifndef PROJECT_BASE_RENDERQUEUE_H
+#define PROJECT_BASE_RENDERQUEUE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLState.h>
+
+namespace rg {
+
+// Passes in submission order, the top bits of every sort key.
+enum class RenderPass : uint32_t {
+    Shadow = 0,
+    Main = 1,
+};
+
+// 64 bit sort key, most significant first:
+//
+//   opaque:       pass:2 | 0:1 | program:16 | material:16 | depth:24 (front to back)
+//   transparent:  pass:2 | 1:1 | ~depth:24  | program:16 | material:16 (back to front)
+//
+// Opaque draws are grouped by state and only ordered by depth inside a group, which keeps program and texture
+// switches down while still drawing mostly front to back for early Z. Transparent draws have to blend in order,
+// so depth wins over state for them.
+const int kDepthBits = 24;
+
+inline uint32_t quantizeDepth(float depth, float maxDepth) {
+    const uint32_t maxValue = (1u << kDepthBits) - 1u;
+    float normalized = std::min(std::max(depth / maxDepth, 0.0f), 1.0f);
+    return (uint32_t)(normalized * (float)maxValue);
+}
+
+inline uint64_t sortKey(RenderPass pass, bool transparent, uint32_t program, uint32_t material, uint32_t depth) {
+    uint64_t key = (uint64_t)pass << 62;
+    uint64_t state = ((uint64_t)(program & 0xFFFF) << 16) | (material & 0xFFFF);
+    if (!transparent)
+        return key | (state << kDepthBits) | depth;
+    uint64_t farFirst = ((1u << kDepthBits) - 1u) - depth;
+    return key | (1ull << 61) | (farFirst << 32) | state;
+}
+
+struct DrawPacket {
+    uint64_t key;
+    Shader* program;
+    Mesh* mesh;
+    // shared by all packets of one model, they have to live until the queue is executed
+    const glm::mat4* transform;
+    const glm::mat3* normalMatrix;
+    // indices drawn, counted from the start of the mesh's range: all of them, or a run of meshlets
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+// Draws of a frame, collected in any order and submitted sorted by key.
+class RenderQueue {
+    typedef DrawElementsIndirectCommand DrawCommand;
+
+    struct Batch {
+        DrawPacket first;
+        size_t firstCommand;
+        size_t count;
+    };
+
+    std::vector<DrawPacket> m_Packets;
+    std::vector<DrawPacket> m_Scratch;
+    std::vector<Batch> m_Batches;
+    std::vector<DrawCommand> m_Commands;
+    std::vector<GLsizei> m_Counts;
+    std::vector<const void*> m_Offsets;
+    std::vector<GLint> m_BaseVertices;
+    GLuint m_IndirectBuffer = 0;
+    size_t m_DrawCalls = 0;
+
+    static size_t indexSize(GLenum type) {
+        return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+    }
+
+    // a packet can join a batch if drawing it alone would not change any state
+    static bool compatible(const DrawPacket& first, const DrawPacket& packet) {
+        return packet.program == first.program && packet.transform == first.transform &&
+               packet.mesh->indexType == first.mesh->indexType &&
+               packet.mesh->VertexArrayFor(*packet.program) == first.mesh->VertexArrayFor(*first.program) &&
+               packet.mesh->SameMaterial(*first.mesh);
+    }
+
+public:
+    RenderQueue() = default;
+
+    ~RenderQueue() {
+        if (m_IndirectBuffer)
+            glDeleteBuffers(1, &m_IndirectBuffer);
+    }
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    void clear() {
+        m_Packets.clear();
+        m_DrawCalls = 0;
+    }
+
+    void submit(const DrawPacket& packet) {
+        m_Packets.push_back(packet);
+    }
+
+    // LSD radix sort over the key bytes, stable. Bytes every key shares (unused passes, the spare program and
+    // material bits) are skipped, so a typical frame takes 5 or 6 scatter passes over the packets.
+    void sort() {
+        size_t count = m_Packets.size();
+        if (count < 2)
+            return;
+        m_Scratch.resize(count);
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t histogram[256] = {};
+            for (const DrawPacket& packet : m_Packets)
+                ++histogram[(packet.key >> shift) & 0xFF];
+            if (histogram[(m_Packets[0].key >> shift) & 0xFF] == count)
+                continue;
+            size_t offset = 0;
+            for (size_t& bucket : histogram) {
+                size_t n = bucket;
+                bucket = offset;
+                offset += n;
+            }
+            for (const DrawPacket& packet : m_Packets)
+                m_Scratch[histogram[(packet.key >> shift) & 0xFF]++] = packet;
+            m_Packets.swap(m_Scratch);
+        }
+    }
+
+    // draws the packets of one pass in queue order; the caller binds the pass's framebuffer and sets its
+    // per pass uniforms first. Programs are only switched and "model" and "normalMatrix" (for programs that have
+    // one) only uploaded when they change.
+    //
+    // Runs of packets with the same program, transform, material and VAO (meshes of one model, see
+    // Model::packGeometry, and the meshlet runs of one mesh) are merged into one multi-draw: glMultiDrawElementsIndirect from a buffer filled once
+    // per pass on GL 4.3, glMultiDrawElementsBaseVertex otherwise.
+    void execute(RenderPass pass) {
+        executeGroups((uint32_t)pass << 1, (uint32_t)pass << 1 | 1u);
+    }
+
+    // only the opaque or only the transparent packets of the pass, for draws outside the queue that have to go
+    // after the opaque ones but before anything is blended over them
+    void execute(RenderPass pass, bool transparent) {
+        uint32_t group = (uint32_t)pass << 1 | (transparent ? 1u : 0u);
+        executeGroups(group, group);
+    }
+
+    // GL draw calls issued since the last clear(), a merged batch counts once
+    size_t drawCalls() const { return m_DrawCalls; }
+
+    size_t size() const { return m_Packets.size(); }
+
+private:
+    // the packets whose pass and transparency bits (the top 3 of the key) are in [first, last]
+    void executeGroups(uint32_t first, uint32_t last) {
+        m_Batches.clear();
+        m_Commands.clear();
+        for (const DrawPacket& packet : m_Packets) {
+            uint32_t group = (uint32_t)(packet.key >> 61);
+            if (group < first)
+                continue;
+            if (group > last)
+                break;
+            if (m_Batches.empty() || !compatible(m_Batches.back().first, packet))
+                m_Batches.push_back({packet, m_Commands.size(), 0});
+            ++m_Batches.back().count;
+            const Mesh& mesh = *packet.mesh;
+            m_Commands.push_back({packet.indexCount, 1,
+                                  (GLuint)(mesh.indexOffset / indexSize(mesh.indexType)) + packet.firstIndex,
+                                  mesh.baseVertex, 0});
+        }
+
+        bool indirect = glext().multiDrawIndirect() && m_Commands.size() > m_Batches.size();
+        if (indirect) {
+            if (!m_IndirectBuffer)
+                glGenBuffers(1, &m_IndirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, m_Commands.size() * sizeof(DrawCommand), m_Commands.data(), GL_STREAM_DRAW);
+        }
+
+        Shader* current = nullptr;
+        const glm::mat4* transform = nullptr;
+        for (const Batch& batch : m_Batches) {
+            const DrawPacket& packet = batch.first;
+            if (packet.program != current) {
+                packet.program->use();
+                current = packet.program;
+                transform = nullptr;
+            }
+            if (packet.transform != transform) {
+                current->setMat4("model"_u, *packet.transform);
+                GLint normalMatrix = current->location("normalMatrix"_u);
+                if (normalMatrix >= 0)
+                    current->setMat3(normalMatrix, *packet.normalMatrix);
+                transform = packet.transform;
+            }
+            ++m_DrawCalls;
+            if (batch.count == 1) {
+                packet.mesh->DrawRange(*current, packet.firstIndex, (GLsizei)packet.indexCount);
+                continue;
+            }
+            packet.mesh->BindMaterial(*current);
+            GLState::bindVertexArray(packet.mesh->VertexArrayFor(*current));
+            if (indirect) {
+                glext().MultiDrawElementsIndirect(GL_TRIANGLES, packet.mesh->indexType,
+                                                  (const void*)(batch.firstCommand * sizeof(DrawCommand)),
+                                                  (GLsizei)batch.count, 0);
+                continue;
+            }
+            m_Counts.clear();
+            m_Offsets.clear();
+            m_BaseVertices.clear();
+            for (size_t i = batch.firstCommand; i < batch.firstCommand + batch.count; ++i) {
+                m_Counts.push_back((GLsizei)m_Commands[i].count);
+                m_Offsets.push_back((const void*)(m_Commands[i].firstIndex * indexSize(packet.mesh->indexType)));
+                m_BaseVertices.push_back(m_Commands[i].baseVertex);
+            }
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_Counts.data(), packet.mesh->indexType, m_Offsets.data(),
+                                          (GLsizei)batch.count, m_BaseVertices.data());
+        }
+        if (indirect)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+};
+
+}
+#endif //PROJECT_BASE_RENDERQUEUE_H
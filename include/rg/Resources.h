@@ -0,0 +1,339 @@
+#ifndef PROJECT_BASE_RESOURCES_H
+#define PROJECT_BASE_RESOURCES_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <rg/Lz4.h>
+#include <rg/MappedFile.h>
+#include <rg/ThreadPool.h>
+
+namespace rg {
+
+// Bytes of one resource. Data either points into a mapping (loose files, stored pack entries) or into a
+// decompressed buffer; owner keeps whichever it is alive.
+struct ResourceData {
+    std::shared_ptr<const void> owner;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    explicit operator bool() const { return owner != nullptr; }
+    std::string str() const { return std::string((const char*)data, size); }
+};
+
+// "resources/./objects\\car/../car/a.png" -> "resources/objects/car/a.png", the form used as pack key
+inline std::string normalizeResourcePath(const std::string& path) {
+    std::vector<std::string> parts;
+    std::string part;
+    for (size_t i = 0; i <= path.size(); ++i) {
+        char c = i < path.size() ? path[i] : '/';
+        if (c != '/' && c != '\\') {
+            part += c;
+            continue;
+        }
+        if (part == "..") {
+            if (!parts.empty() && parts.back() != "..")
+                parts.pop_back();
+            else
+                parts.push_back(part);
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        part.clear();
+    }
+    std::string result = !path.empty() && path[0] == '/' ? "/" : "";
+    for (size_t i = 0; i < parts.size(); ++i)
+        result += (i ? "/" : "") + parts[i];
+    return result;
+}
+
+// Single file archive: header, entry payloads, then a central index at the end.
+//
+//   header:  u32 magic "RGPK", u32 version, u32 entry count, u32 reserved, u64 index offset
+//   entry:   u16 path length, path bytes, u8 codec, u64 offset, u64 stored size, u64 size
+//
+// All integers are little endian. Payloads are 16 byte aligned; stored entries are read in place from the mapping,
+// LZ4 entries are decompressed on demand or ahead of time on the worker threads.
+class ResourcePack {
+public:
+    static constexpr uint32_t kMagic = 0x4B504752; // "RGPK"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kHeaderSize = 24;
+    static constexpr size_t kAlignment = 16;
+
+    enum Codec : uint8_t { Stored = 0, Lz4 = 1 };
+
+    struct Entry {
+        uint8_t codec;
+        uint64_t offset;
+        uint64_t storedSize;
+        uint64_t size;
+    };
+
+private:
+    std::shared_ptr<MappedFile> m_File;
+    std::unordered_map<std::string, Entry> m_Entries;
+    mutable std::mutex m_CacheMutex;
+    mutable std::unordered_map<std::string, std::shared_future<std::shared_ptr<std::vector<unsigned char>>>> m_Cache;
+
+    template<typename T>
+    static T readValue(const unsigned char*& p) {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    template<typename T>
+    static void writeValue(std::ostream& out, T value) {
+        out.write((const char*)&value, sizeof(T));
+    }
+
+    std::shared_ptr<std::vector<unsigned char>> decompress(const Entry& entry) const {
+        auto buffer = std::make_shared<std::vector<unsigned char>>(entry.size);
+        if (!lz4::decompress(m_File->data() + entry.offset, entry.storedSize, buffer->data(), buffer->size()))
+            return nullptr;
+        return buffer;
+    }
+
+public:
+    bool open(const std::string& path) {
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(path) || file->size() < kHeaderSize)
+            return false;
+        const unsigned char* p = file->data();
+        uint32_t magic = readValue<uint32_t>(p);
+        uint32_t version = readValue<uint32_t>(p);
+        uint32_t entryCount = readValue<uint32_t>(p);
+        readValue<uint32_t>(p);
+        uint64_t indexOffset = readValue<uint64_t>(p);
+        if (magic != kMagic || version != kVersion || indexOffset > file->size()) {
+            std::cout << "ERROR::RESOURCE_PACK:: " << path << " is not a valid pack" << std::endl;
+            return false;
+        }
+
+        const unsigned char* end = file->data() + file->size();
+        p = file->data() + indexOffset;
+        std::unordered_map<std::string, Entry> entries;
+        entries.reserve(entryCount);
+        for (uint32_t i = 0; i < entryCount; ++i) {
+            if (end - p < 2)
+                return false;
+            uint16_t pathLength = readValue<uint16_t>(p);
+            if ((size_t)(end - p) < pathLength + 25u)
+                return false;
+            std::string name((const char*)p, pathLength);
+            p += pathLength;
+            Entry entry;
+            entry.codec = readValue<uint8_t>(p);
+            entry.offset = readValue<uint64_t>(p);
+            entry.storedSize = readValue<uint64_t>(p);
+            entry.size = readValue<uint64_t>(p);
+            if (entry.offset + entry.storedSize > indexOffset || (entry.codec == Stored && entry.storedSize != entry.size)) {
+                std::cout << "ERROR::RESOURCE_PACK:: corrupt entry " << name << " in " << path << std::endl;
+                return false;
+            }
+            entries.emplace(std::move(name), entry);
+        }
+        m_File = std::move(file);
+        m_Entries = std::move(entries);
+        return true;
+    }
+
+    const Entry* find(const std::string& normalizedPath) const {
+        auto it = m_Entries.find(normalizedPath);
+        return it == m_Entries.end() ? nullptr : &it->second;
+    }
+
+    size_t entryCount() const { return m_Entries.size(); }
+
+    bool read(const std::string& normalizedPath, ResourceData& out) const {
+        const Entry* entry = find(normalizedPath);
+        if (!entry)
+            return false;
+        if (entry->codec == Stored) {
+            out.owner = m_File;
+            out.data = m_File->data() + entry->offset;
+            out.size = entry->size;
+            return true;
+        }
+        std::shared_future<std::shared_ptr<std::vector<unsigned char>>> pending;
+        {
+            std::lock_guard<std::mutex> lock(m_CacheMutex);
+            auto it = m_Cache.find(normalizedPath);
+            if (it != m_Cache.end())
+                pending = it->second;
+        }
+        // waits if a worker is still decompressing it
+        std::shared_ptr<std::vector<unsigned char>> buffer = pending.valid() ? pending.get() : decompress(*entry);
+        if (!buffer) {
+            std::cout << "ERROR::RESOURCE_PACK:: failed to decompress " << normalizedPath << std::endl;
+            return false;
+        }
+        out.owner = buffer;
+        out.data = buffer->data();
+        out.size = buffer->size();
+        return true;
+    }
+
+    // queues decompression of every compressed entry on the pool; read() picks the results up
+    void prefetchAll(ThreadPool& pool) {
+        std::lock_guard<std::mutex> lock(m_CacheMutex);
+        for (const auto& item : m_Entries) {
+            if (item.second.codec == Stored || m_Cache.count(item.first))
+                continue;
+            const Entry* entry = &item.second;
+            m_Cache.emplace(item.first, pool.submit([this, entry] { return decompress(*entry); }).share());
+        }
+    }
+
+    // drops the decompressed copies, ResourceData handed out earlier stays valid
+    void releaseCache() {
+        std::lock_guard<std::mutex> lock(m_CacheMutex);
+        for (auto& item : m_Cache)
+            item.second.wait();
+        m_Cache.clear();
+    }
+
+    // writes files (pack path, disk path) into a new pack, compressing entries where LZ4 actually saves space
+    static bool write(const std::string& packPath, const std::vector<std::pair<std::string, std::string>>& files, std::string* error) {
+        std::ofstream out(packPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            if (error) *error = "cannot create " + packPath;
+            return false;
+        }
+        std::vector<std::pair<std::string, Entry>> index;
+        std::vector<char> padding(kHeaderSize + kAlignment, 0);
+        out.write(padding.data(), kHeaderSize);
+        uint64_t offset = kHeaderSize;
+        for (const auto& file : files) {
+            MappedFile source;
+            std::string name = normalizeResourcePath(file.first);
+            if (name.size() > 0xFFFF) {
+                if (error) *error = "path too long: " + name;
+                return false;
+            }
+            // empty files cannot be mapped but are valid entries
+            struct stat st;
+            if (stat(file.second.c_str(), &st) != 0 || (st.st_size > 0 && !source.open(file.second))) {
+                if (error) *error = "cannot read " + file.second;
+                return false;
+            }
+            size_t alignedOffset = (offset + kAlignment - 1) / kAlignment * kAlignment;
+            out.write(padding.data(), alignedOffset - offset);
+            offset = alignedOffset;
+
+            Entry entry{Stored, offset, source.size(), source.size()};
+            std::vector<unsigned char> compressed(lz4::compressBound(source.size()));
+            size_t compressedSize = lz4::compress(source.data(), source.size(), compressed.data(), compressed.size());
+            // already compressed formats (png, jpg) usually do not shrink, keep those readable in place
+            if (compressedSize > 0 && compressedSize < source.size() - source.size() / 16) {
+                entry.codec = Lz4;
+                entry.storedSize = compressedSize;
+                out.write((const char*)compressed.data(), compressedSize);
+            } else if (source.size() > 0) {
+                out.write((const char*)source.data(), source.size());
+            }
+            offset += entry.storedSize;
+            index.emplace_back(name, entry);
+        }
+
+        uint64_t indexOffset = offset;
+        for (const auto& item : index) {
+            writeValue<uint16_t>(out, (uint16_t)item.first.size());
+            out.write(item.first.data(), item.first.size());
+            writeValue<uint8_t>(out, item.second.codec);
+            writeValue<uint64_t>(out, item.second.offset);
+            writeValue<uint64_t>(out, item.second.storedSize);
+            writeValue<uint64_t>(out, item.second.size);
+        }
+        out.seekp(0);
+        writeValue<uint32_t>(out, kMagic);
+        writeValue<uint32_t>(out, kVersion);
+        writeValue<uint32_t>(out, (uint32_t)index.size());
+        writeValue<uint32_t>(out, 0);
+        writeValue<uint64_t>(out, indexOffset);
+        if (!out) {
+            if (error) *error = "write to " + packPath + " failed";
+            return false;
+        }
+        return true;
+    }
+};
+
+// Entry point for every loader: looks a path up in the mounted pack first and falls back to the file system,
+// so the same paths work with and without a pack.
+class Resources {
+    static std::unique_ptr<ResourcePack>& mountedPack() {
+        static std::unique_ptr<ResourcePack> pack;
+        return pack;
+    }
+
+public:
+    static bool mount(const std::string& packPath) {
+        std::unique_ptr<ResourcePack> pack(new ResourcePack);
+        if (!pack->open(packPath))
+            return false;
+        mountedPack() = std::move(pack);
+        return true;
+    }
+
+    static ResourcePack* pack() { return mountedPack().get(); }
+
+    static bool exists(const std::string& path) {
+        if (pack() && pack()->find(normalizeResourcePath(path)))
+            return true;
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+    }
+
+    static bool read(const std::string& path, ResourceData& out) {
+        if (pack() && pack()->read(normalizeResourcePath(path), out))
+            return true;
+        auto file = std::make_shared<MappedFile>();
+        if (file->open(path)) {
+            out.data = file->data();
+            out.size = file->size();
+            out.owner = std::move(file);
+            return true;
+        }
+        // mmap refuses empty files, they still exist
+        if (exists(path)) {
+            out.owner = std::make_shared<std::vector<unsigned char>>();
+            out.data = nullptr;
+            out.size = 0;
+            return true;
+        }
+        return false;
+    }
+
+    static bool readText(const std::string& path, std::string& out) {
+        ResourceData data;
+        if (!read(path, data))
+            return false;
+        out = data.str();
+        return true;
+    }
+
+    static void prefetchAll() {
+        if (pack())
+            pack()->prefetchAll(ThreadPool::shared());
+    }
+
+    static void releaseCache() {
+        if (pack())
+            pack()->releaseCache();
+    }
+};
+
+}
+#endif //PROJECT_BASE_RESOURCES_H
@@ -0,0 +1,455 @@
+#ifndef PROJECT_BASE_SCENE_H
+#define PROJECT_BASE_SCENE_H
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <rg/Bounds.h>
+
+namespace rg {
+
+// Entity handle: its slot in the low 24 bits and how often the slot has been reused in the high 8, so a handle kept
+// past destroy() does not find the entity that took the slot over.
+typedef uint32_t Entity;
+const Entity kNullEntity = 0xFFFFFFFFu;
+
+// row of an entity without the component
+const uint32_t kNoRow = 0xFFFFFFFFu;
+
+inline uint32_t entitySlot(Entity entity) { return entity & 0x00FFFFFFu; }
+
+// Which row of a component store belongs to which entity. Rows stay dense: removing one moves the last row into the
+// hole, which the store then does to each of its columns (removeRow), so systems walk the columns front to back
+// without skipping anything.
+class EntityRows {
+    std::vector<uint32_t> m_Rows;   // by entity slot
+    std::vector<Entity> m_Entities; // by row
+
+public:
+    // row of the entity, appended if it has none yet
+    uint32_t add(Entity entity) {
+        uint32_t existing = row(entity);
+        if (existing != kNoRow)
+            return existing;
+        uint32_t slot = entitySlot(entity);
+        if (slot >= m_Rows.size())
+            m_Rows.resize(slot + 1, kNoRow);
+        m_Rows[slot] = (uint32_t)m_Entities.size();
+        m_Entities.push_back(entity);
+        return m_Rows[slot];
+    }
+
+    // row the entity had, which the last row has been moved into; kNoRow if it had none
+    uint32_t remove(Entity entity) {
+        uint32_t removed = row(entity);
+        if (removed == kNoRow)
+            return kNoRow;
+        Entity last = m_Entities.back();
+        m_Entities[removed] = last;
+        m_Rows[entitySlot(last)] = removed;
+        m_Rows[entitySlot(entity)] = kNoRow;
+        m_Entities.pop_back();
+        return removed;
+    }
+
+    uint32_t row(Entity entity) const {
+        uint32_t slot = entitySlot(entity);
+        if (slot >= m_Rows.size() || m_Rows[slot] == kNoRow || m_Entities[m_Rows[slot]] != entity)
+            return kNoRow;
+        return m_Rows[slot];
+    }
+
+    Entity entity(uint32_t row) const { return m_Entities[row]; }
+    size_t size() const { return m_Entities.size(); }
+};
+
+template<typename T>
+inline void removeRow(std::vector<T>& column, uint32_t row) {
+    column[row] = column.back();
+    column.pop_back();
+}
+
+// Placement of an entity relative to its parent (the world if it has none): local = translate(position) * rotation *
+// scale, world = parent world * local. World and normal matrices are cached; updateTransforms only recomputes the rows
+// marked dirty and the rows under them, and leaves the columns as the one copy every pass of the frame reads.
+struct TransformComponents {
+    EntityRows rows;
+    std::vector<glm::vec3> position;
+    std::vector<glm::quat> rotation;
+    std::vector<glm::vec3> scale;
+    std::vector<Entity> parent;
+    std::vector<uint8_t> dirty;    // local placement or parent changed since the last update
+    std::vector<uint8_t> changed;  // world matrix recomputed by the last update
+    std::vector<glm::mat4> world;
+    std::vector<glm::mat3> normal; // inverse transpose of the world matrix's upper 3x3, for normals
+    std::vector<uint32_t> updateStack; // scratch of updateTransforms
+
+    // drops the entity's row, leaving its children pointing at it
+    bool removeRows(Entity entity) {
+        uint32_t row = rows.remove(entity);
+        if (row == kNoRow)
+            return false;
+        removeRow(position, row);
+        removeRow(rotation, row);
+        removeRow(scale, row);
+        removeRow(parent, row);
+        removeRow(dirty, row);
+        removeRow(changed, row);
+        removeRow(world, row);
+        removeRow(normal, row);
+        return true;
+    }
+
+    uint32_t add(Entity entity, const glm::vec3& at, const glm::quat& turn = glm::quat(),
+                 const glm::vec3& size = glm::vec3(1.0f), Entity parentEntity = kNullEntity) {
+        uint32_t row = rows.add(entity);
+        if (row == position.size()) {
+            position.push_back(at);
+            rotation.push_back(turn);
+            scale.push_back(size);
+            parent.push_back(kNullEntity);
+            dirty.push_back(1);
+            changed.push_back(0);
+            world.push_back(glm::mat4(1.0f));
+            normal.push_back(glm::mat3(1.0f));
+        } else {
+            position[row] = at;
+            rotation[row] = turn;
+            scale[row] = size;
+            parent[row] = kNullEntity;
+            dirty[row] = 1;
+        }
+        if (parentEntity != kNullEntity)
+            setParent(entity, parentEntity);
+        return row;
+    }
+
+    void remove(Entity entity) {
+        if (!removeRows(entity))
+            return;
+        // children now hang off the world
+        for (size_t child = 0; child < parent.size(); ++child) {
+            if (parent[child] == entity) {
+                parent[child] = kNullEntity;
+                dirty[child] = 1;
+            }
+        }
+    }
+
+    // same for many entities, with one pass over the children for all of them
+    void remove(const Entity* entities, size_t count) {
+        bool removed = false;
+        for (size_t i = 0; i < count; ++i)
+            removed = removeRows(entities[i]) || removed;
+        if (!removed)
+            return;
+        for (size_t child = 0; child < parent.size(); ++child) {
+            if (parent[child] != kNullEntity && rows.row(parent[child]) == kNoRow) {
+                parent[child] = kNullEntity;
+                dirty[child] = 1;
+            }
+        }
+    }
+
+    void setPosition(Entity entity, const glm::vec3& at) {
+        uint32_t row = rows.row(entity);
+        if (row != kNoRow) {
+            position[row] = at;
+            dirty[row] = 1;
+        }
+    }
+
+    void setRotation(Entity entity, const glm::quat& turn) {
+        uint32_t row = rows.row(entity);
+        if (row != kNoRow) {
+            rotation[row] = turn;
+            dirty[row] = 1;
+        }
+    }
+
+    void setScale(Entity entity, const glm::vec3& size) {
+        uint32_t row = rows.row(entity);
+        if (row != kNoRow) {
+            scale[row] = size;
+            dirty[row] = 1;
+        }
+    }
+
+    // false (and nothing changed) if the entity has no transform or the parent is the entity or one of its children
+    bool setParent(Entity entity, Entity parentEntity) {
+        uint32_t row = rows.row(entity);
+        if (row == kNoRow)
+            return false;
+        for (Entity ancestor = parentEntity; ancestor != kNullEntity;) {
+            uint32_t ancestorRow = rows.row(ancestor);
+            if (ancestorRow == kNoRow)
+                break;
+            if (ancestor == entity) {
+                std::cout << "ERROR::SCENE:: parenting entity " << entity << " to " << parentEntity
+                          << " would make a cycle" << std::endl;
+                return false;
+            }
+            ancestor = parent[ancestorRow];
+        }
+        parent[row] = parentEntity;
+        dirty[row] = 1;
+        return true;
+    }
+};
+
+enum RenderableFlags : uint8_t {
+    kCastsShadow = 1 << 0,
+    kOccluder = 1 << 1,  // drawn into the CPU occlusion buffer
+    kInstanced = 1 << 2, // drawn with the other instanced copies of its model instead of mesh by mesh
+};
+
+// Something drawn: which of the loaded models, and how
+struct RenderableComponents {
+    EntityRows rows;
+    std::vector<uint32_t> model;
+    std::vector<uint8_t> flags;
+
+    uint32_t add(Entity entity, uint32_t modelIndex, uint8_t renderFlags = kCastsShadow) {
+        uint32_t row = rows.add(entity);
+        if (row == model.size()) {
+            model.push_back(modelIndex);
+            flags.push_back(renderFlags);
+        } else {
+            model[row] = modelIndex;
+            flags[row] = renderFlags;
+        }
+        return row;
+    }
+
+    void remove(Entity entity) {
+        uint32_t row = rows.remove(entity);
+        if (row == kNoRow)
+            return;
+        removeRow(model, row);
+        removeRow(flags, row);
+    }
+};
+
+// color and attenuation of one light
+struct LightColor {
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    glm::vec3 specular = glm::vec3(0.0f);
+    glm::vec3 attenuation = glm::vec3(1.0f, 0.0f, 0.0f); // constant, linear, quadratic
+};
+
+// what a light entity adds to its slot of the shader's light arrays (rg::LightUniforms): a point light and a spot
+// light, both at the entity's position
+struct LightSource {
+    int slot = 0;
+    LightColor point;
+    LightColor spot;
+    glm::vec3 spotDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+    glm::vec2 spotCutOff = glm::vec2(0.0f); // inner and outer angle in degrees
+};
+
+struct LightComponents {
+    EntityRows rows;
+    std::vector<int> slot;
+    std::vector<LightColor> point;
+    std::vector<LightColor> spot;
+    std::vector<glm::vec3> spotDirection;
+    std::vector<glm::vec2> spotCutOff;
+
+    uint32_t add(Entity entity, const LightSource& source) {
+        uint32_t row = rows.add(entity);
+        if (row == slot.size()) {
+            slot.push_back(source.slot);
+            point.push_back(source.point);
+            spot.push_back(source.spot);
+            spotDirection.push_back(source.spotDirection);
+            spotCutOff.push_back(source.spotCutOff);
+        } else {
+            slot[row] = source.slot;
+            point[row] = source.point;
+            spot[row] = source.spot;
+            spotDirection[row] = source.spotDirection;
+            spotCutOff[row] = source.spotCutOff;
+        }
+        return row;
+    }
+
+    void remove(Entity entity) {
+        uint32_t row = rows.remove(entity);
+        if (row == kNoRow)
+            return;
+        removeRow(slot, row);
+        removeRow(point, row);
+        removeRow(spot, row);
+        removeRow(spotDirection, row);
+        removeRow(spotCutOff, row);
+    }
+};
+
+// Model space box of the entity and the world box around it, written by updateBounds
+struct BoundsComponents {
+    EntityRows rows;
+    std::vector<Aabb> local;
+    std::vector<Aabb> world;
+    std::vector<uint8_t> dirty; // local box changed since the last update
+
+    uint32_t add(Entity entity, const Aabb& box) {
+        uint32_t row = rows.add(entity);
+        if (row == local.size()) {
+            local.push_back(box);
+            world.push_back(box);
+            dirty.push_back(1);
+        } else {
+            local[row] = box;
+            dirty[row] = 1;
+        }
+        return row;
+    }
+
+    void remove(Entity entity) {
+        uint32_t row = rows.remove(entity);
+        if (row == kNoRow)
+            return;
+        removeRow(local, row);
+        removeRow(world, row);
+        removeRow(dirty, row);
+    }
+};
+
+// Entities and their components, each component type in its own store of parallel arrays. An entity is just a
+// handle; it is whatever components were added for it.
+class Scene {
+    std::vector<uint8_t> m_Generations; // by slot
+    std::vector<uint32_t> m_FreeSlots;
+    size_t m_Alive = 0;
+
+public:
+    TransformComponents transforms;
+    RenderableComponents renderables;
+    LightComponents lights;
+    BoundsComponents bounds;
+
+    Entity create() {
+        uint32_t slot;
+        if (!m_FreeSlots.empty()) {
+            slot = m_FreeSlots.back();
+            m_FreeSlots.pop_back();
+        } else {
+            slot = (uint32_t)m_Generations.size();
+            m_Generations.push_back(0);
+        }
+        ++m_Alive;
+        return slot | ((Entity)m_Generations[slot] << 24);
+    }
+
+    void destroy(Entity entity) {
+        if (!alive(entity))
+            return;
+        transforms.remove(entity);
+        renderables.remove(entity);
+        lights.remove(entity);
+        bounds.remove(entity);
+        uint32_t slot = entitySlot(entity);
+        ++m_Generations[slot];
+        m_FreeSlots.push_back(slot);
+        --m_Alive;
+    }
+
+    // destroys many entities at once, cheaper than one by one when they have transforms
+    void destroy(const std::vector<Entity>& entities) {
+        transforms.remove(entities.data(), entities.size());
+        for (Entity entity : entities)
+            destroy(entity);
+    }
+
+    bool alive(Entity entity) const {
+        uint32_t slot = entitySlot(entity);
+        return entity != kNullEntity && slot < m_Generations.size() && m_Generations[slot] == entity >> 24;
+    }
+
+    size_t size() const { return m_Alive; }
+
+    // world matrix of the entity as of the last updateTransforms, identity if it has no transform
+    const glm::mat4& world(Entity entity) const {
+        static const glm::mat4 identity(1.0f);
+        uint32_t row = transforms.rows.row(entity);
+        return row == kNoRow ? identity : transforms.world[row];
+    }
+
+    const glm::mat3& normalMatrix(Entity entity) const {
+        static const glm::mat3 identity(1.0f);
+        uint32_t row = transforms.rows.row(entity);
+        return row == kNoRow ? identity : transforms.normal[row];
+    }
+};
+
+// true if the upper 3x3 of the world matrix is a rotation times one scale factor, parents included: the axes have
+// the same length and stay perpendicular. Only then is that 3x3 good enough as the normal matrix.
+inline bool uniformlyScaled(const glm::mat4& world) {
+    glm::vec3 x(world[0]), y(world[1]), z(world[2]);
+    float length = glm::dot(x, x);
+    float tolerance = 1e-3f * length;
+    return glm::abs(glm::dot(y, y) - length) <= tolerance && glm::abs(glm::dot(z, z) - length) <= tolerance &&
+           glm::abs(glm::dot(x, y)) <= tolerance && glm::abs(glm::dot(x, z)) <= tolerance &&
+           glm::abs(glm::dot(y, z)) <= tolerance;
+}
+
+// systems, each one a linear pass over the rows of the stores it reads and writes
+
+// Recomputes the world and normal matrix of every dirty row and of every row whose parent was recomputed, parents
+// before children, and sets changed for exactly those rows. Rows that did not move cost a flag test.
+inline void updateTransforms(TransformComponents& transforms) {
+    const uint8_t kPending = 2; // changed until the row is visited: not yet known
+    size_t count = transforms.world.size();
+    transforms.changed.assign(count, kPending);
+    std::vector<uint32_t>& stack = transforms.updateStack;
+    for (uint32_t first = 0; first < count; ++first) {
+        // the row and its ancestors up to the first one already visited, nearest first
+        stack.clear();
+        for (uint32_t row = first; row != kNoRow && transforms.changed[row] == kPending;) {
+            stack.push_back(row);
+            Entity parentEntity = transforms.parent[row];
+            row = parentEntity == kNullEntity ? kNoRow : transforms.rows.row(parentEntity);
+        }
+        while (!stack.empty()) {
+            uint32_t row = stack.back();
+            stack.pop_back();
+            Entity parentEntity = transforms.parent[row];
+            uint32_t parentRow = parentEntity == kNullEntity ? kNoRow : transforms.rows.row(parentEntity);
+            bool parentChanged = parentRow != kNoRow && transforms.changed[parentRow];
+            if (!transforms.dirty[row] && !parentChanged) {
+                transforms.changed[row] = 0;
+                continue;
+            }
+            glm::mat4 local = glm::mat4_cast(transforms.rotation[row]);
+            local[0] *= transforms.scale[row].x;
+            local[1] *= transforms.scale[row].y;
+            local[2] *= transforms.scale[row].z;
+            local[3] = glm::vec4(transforms.position[row], 1.0f);
+            transforms.world[row] = parentRow == kNoRow ? local : transforms.world[parentRow] * local;
+            transforms.normal[row] = glm::transpose(glm::inverse(glm::mat3(transforms.world[row])));
+            transforms.dirty[row] = 0;
+            transforms.changed[row] = 1;
+        }
+    }
+}
+
+// world boxes of the entities whose box or transform changed, the latter as of the last updateTransforms
+inline void updateBounds(BoundsComponents& bounds, const Scene& scene) {
+    const TransformComponents& transforms = scene.transforms;
+    for (size_t row = 0; row < bounds.local.size(); ++row) {
+        uint32_t transform = transforms.rows.row(bounds.rows.entity((uint32_t)row));
+        bool moved = transform != kNoRow && transforms.changed[transform];
+        if (!bounds.dirty[row] && !moved)
+            continue;
+        bounds.world[row] = transform == kNoRow ? bounds.local[row]
+                                                : transformAabb(bounds.local[row], transforms.world[transform]);
+        bounds.dirty[row] = 0;
+    }
+}
+
+}
+#endif //PROJECT_BASE_SCENE_H
@@ -0,0 +1,533 @@
+#ifndef PROJECT_BASE_SCENEFILE_H
+#define PROJECT_BASE_SCENEFILE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <rg/Resources.h>
+#include <rg/Scene.h>
+#include <rg/ThreadPool.h>
+
+namespace rg {
+
+const uint32_t kNoParent = 0xFFFFFFFFu;
+
+struct SceneModel {
+    std::string name;
+    std::string path;
+};
+
+// One placed copy of a model. Parent is the index of another instance of the same file, which the placement is then
+// relative to.
+struct SceneInstance {
+    uint32_t model;
+    uint32_t parent;
+    uint32_t flags;     // RenderableFlags
+    glm::vec3 position;
+    glm::vec3 rotation; // euler angles in degrees
+    glm::vec3 scale;
+};
+static_assert(sizeof(SceneInstance) == 48, "instances are read and written as 48 byte records");
+
+struct SceneLight {
+    glm::vec3 position;
+    LightSource source;
+};
+
+struct SceneDescription {
+    std::vector<SceneModel> models;
+    std::vector<SceneInstance> instances;
+    std::vector<SceneLight> lights;
+};
+
+// Scene files: the models a scene uses, the instances placing them and its lights, in a text form to write by hand
+// and a binary form for large scenes. load() takes either.
+//
+// Text form, one statement per line, '#' starts a comment; instances are numbered in file order from 0:
+//
+//   model <name> <path>
+//   instance <model name> <position xyz> <rotation xyz, degrees> <scale xyz> [shadow] [occluder] [instanced]
+//            [parent <instance>]
+//   light <slot> <position xyz> point <color> spot <direction xyz> <color> <inner outer angle, degrees>
+//
+// with <color> = <ambient rgb> <diffuse rgb> <specular rgb> <constant linear quadratic>, every statement on one
+// line. The text is split at line starts into one piece per thread and the pieces are parsed in parallel.
+//
+// Binary form, all integers and floats little endian:
+//
+//   header:    u32 magic "RGSC", u32 version, u32 model count, u32 instance count, u32 light count, u32 reserved
+//   model:     u16 name length, name, u16 path length, path
+//   instance:  u32 model, u32 parent, u32 flags, f32 position[3], rotation[3], scale[3]
+//   light:     i32 slot, f32 position[3], point color[12], spot color[12], spot direction[3], spot angles[2]
+class SceneFile {
+public:
+    static constexpr uint32_t kMagic = 0x43534752; // "RGSC"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kHeaderSize = 24;
+    static constexpr size_t kLightSize = 4 + 32 * 4;
+
+private:
+    // what one piece of the text parsed to, merged in piece order afterwards
+    struct Piece {
+        const char* begin;
+        const char* end;
+        std::vector<SceneModel> models;
+        std::vector<SceneInstance> instances;
+        std::vector<std::pair<const char*, size_t>> instanceModels; // model name of each instance, into the text
+        std::vector<SceneLight> lights;
+        size_t lines = 0;
+        size_t errorLine = 0; // 1 based within the piece, 0 if it parsed
+        std::string error;
+    };
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static void skipSpaces(const char*& p, const char* end) {
+        while (p < end && isSpace(*p))
+            ++p;
+    }
+
+    static bool token(const char*& p, const char* end, const char*& begin, size_t& length) {
+        skipSpaces(p, end);
+        begin = p;
+        while (p < end && !isSpace(*p) && *p != '#')
+            ++p;
+        length = (size_t)(p - begin);
+        return length > 0;
+    }
+
+    static bool keyword(const char*& p, const char* end, const char* word) {
+        const char* begin;
+        size_t length;
+        const char* start = p;
+        if (token(p, end, begin, length) && length == std::strlen(word) && std::memcmp(begin, word, length) == 0)
+            return true;
+        p = start;
+        return false;
+    }
+
+    // decimal float without going through strtod, which needs a terminated string and the C locale
+    static bool number(const char*& p, const char* end, float& out) {
+        skipSpaces(p, end);
+        const char* start = p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+        uint64_t mantissa = 0;
+        int exponent = 0, digits = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+            if (mantissa < 100000000000000000ull)
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            else
+                ++exponent;
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+                if (mantissa < 100000000000000000ull) {
+                    mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                    --exponent;
+                }
+            }
+        }
+        if (digits == 0) {
+            p = start;
+            return false;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+                negativeExponent = *p++ == '-';
+            int value = 0;
+            for (; p < end && *p >= '0' && *p <= '9'; ++p)
+                value = std::min(value * 10 + (*p - '0'), 1000);
+            exponent += negativeExponent ? -value : value;
+        }
+        double value = (double)mantissa;
+        if (exponent != 0)
+            value = exponent < 0 ? value / std::pow(10.0, -exponent) : value * std::pow(10.0, exponent);
+        out = (float)(negative ? -value : value);
+        return p == end || isSpace(*p) || *p == '#';
+    }
+
+    static bool vec3(const char*& p, const char* end, glm::vec3& out) {
+        return number(p, end, out.x) && number(p, end, out.y) && number(p, end, out.z);
+    }
+
+    static bool color(const char*& p, const char* end, LightColor& out) {
+        return vec3(p, end, out.ambient) && vec3(p, end, out.diffuse) && vec3(p, end, out.specular) &&
+               vec3(p, end, out.attenuation);
+    }
+
+    static bool fail(Piece& piece, const std::string& error) {
+        piece.errorLine = piece.lines;
+        piece.error = error;
+        return false;
+    }
+
+    static bool parseLine(Piece& piece, const char* p, const char* end) {
+        const char* word;
+        size_t length;
+        if (!token(p, end, word, length))
+            return true; // blank or comment
+        std::string statement(word, length);
+        if (statement == "model") {
+            SceneModel model;
+            const char* name;
+            if (!token(p, end, name, length))
+                return fail(piece, "model without a name");
+            model.name.assign(name, length);
+            skipSpaces(p, end);
+            const char* pathEnd = p;
+            for (const char* c = p; c < end && *c != '#'; ++c) {
+                if (!isSpace(*c))
+                    pathEnd = c + 1;
+            }
+            if (pathEnd == p)
+                return fail(piece, "model " + model.name + " without a path");
+            model.path.assign(p, pathEnd);
+            piece.models.push_back(model);
+            return true;
+        }
+        if (statement == "instance") {
+            SceneInstance instance{0, kNoParent, 0, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f)};
+            const char* model;
+            size_t modelLength;
+            if (!token(p, end, model, modelLength) || !vec3(p, end, instance.position) ||
+                !vec3(p, end, instance.rotation) || !vec3(p, end, instance.scale))
+                return fail(piece, "instance needs a model, a position, a rotation and a scale");
+            while (token(p, end, word, length)) {
+                std::string option(word, length);
+                float parent;
+                if (option == "shadow")
+                    instance.flags |= kCastsShadow;
+                else if (option == "occluder")
+                    instance.flags |= kOccluder;
+                else if (option == "instanced")
+                    instance.flags |= kInstanced;
+                else if (option == "parent" && number(p, end, parent) && parent >= 0.0f)
+                    instance.parent = (uint32_t)parent;
+                else
+                    return fail(piece, "unknown instance option " + option);
+            }
+            piece.instances.push_back(instance);
+            piece.instanceModels.emplace_back(model, modelLength);
+            return true;
+        }
+        if (statement == "light") {
+            SceneLight light;
+            float slot;
+            if (!number(p, end, slot) || !vec3(p, end, light.position) || !keyword(p, end, "point") ||
+                !color(p, end, light.source.point) || !keyword(p, end, "spot") ||
+                !vec3(p, end, light.source.spotDirection) || !color(p, end, light.source.spot) ||
+                !number(p, end, light.source.spotCutOff.x) || !number(p, end, light.source.spotCutOff.y))
+                return fail(piece, "malformed light");
+            light.source.slot = (int)slot;
+            piece.lights.push_back(light);
+            return true;
+        }
+        return fail(piece, "unknown statement " + statement);
+    }
+
+    static void parsePiece(Piece& piece) {
+        const char* p = piece.begin;
+        while (p < piece.end) {
+            const char* lineEnd = (const char*)std::memchr(p, '\n', (size_t)(piece.end - p));
+            if (!lineEnd)
+                lineEnd = piece.end;
+            ++piece.lines;
+            if (!parseLine(piece, p, lineEnd))
+                return;
+            p = lineEnd + 1;
+        }
+    }
+
+    template<typename T>
+    static T readValue(const unsigned char*& p) {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    template<typename T>
+    static void writeValue(std::ostream& out, T value) {
+        out.write((const char*)&value, sizeof(T));
+    }
+
+    static void writeFloats(std::ostream& out, const float* values, size_t count) {
+        out.write((const char*)values, count * sizeof(float));
+    }
+
+    static void writeColor(std::ostream& out, const LightColor& color) {
+        writeFloats(out, &color.ambient.x, 3);
+        writeFloats(out, &color.diffuse.x, 3);
+        writeFloats(out, &color.specular.x, 3);
+        writeFloats(out, &color.attenuation.x, 3);
+    }
+
+    static void readFloats(const unsigned char*& p, float* values, size_t count) {
+        std::memcpy(values, p, count * sizeof(float));
+        p += count * sizeof(float);
+    }
+
+    static void readColor(const unsigned char*& p, LightColor& color) {
+        readFloats(p, &color.ambient.x, 3);
+        readFloats(p, &color.diffuse.x, 3);
+        readFloats(p, &color.specular.x, 3);
+        readFloats(p, &color.attenuation.x, 3);
+    }
+
+    static void printColor(std::ostream& out, const LightColor& color) {
+        for (const glm::vec3& value : {color.ambient, color.diffuse, color.specular, color.attenuation})
+            out << "  " << value.x << ' ' << value.y << ' ' << value.z;
+    }
+
+public:
+    static bool parseText(const char* text, size_t size, SceneDescription& out, std::string* error) {
+        // pieces of roughly equal size, each starting at a line start
+        ThreadPool& pool = ThreadPool::shared();
+        const size_t kMinPiece = 64 * 1024;
+        size_t pieceCount = std::max<size_t>(1, std::min(size / kMinPiece, 4 * (pool.size() + 1)));
+        std::vector<Piece> pieces(pieceCount);
+        const char* begin = text;
+        const char* end = text + size;
+        for (size_t i = 0; i < pieceCount; ++i) {
+            const char* pieceEnd = i + 1 == pieceCount ? end : std::max(begin, text + size * (i + 1) / pieceCount);
+            const char* newline = (const char*)std::memchr(pieceEnd, '\n', (size_t)(end - pieceEnd));
+            pieceEnd = i + 1 == pieceCount || !newline ? end : newline + 1;
+            pieces[i].begin = begin;
+            pieces[i].end = pieceEnd;
+            begin = pieceEnd;
+        }
+        pool.parallelFor(pieceCount, 1, [&pieces](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i)
+                parsePiece(pieces[i]);
+        });
+
+        out = SceneDescription();
+        size_t line = 0, instanceCount = 0;
+        for (const Piece& piece : pieces) {
+            if (piece.errorLine) {
+                if (error)
+                    *error = "line " + std::to_string(line + piece.errorLine) + ": " + piece.error;
+                return false;
+            }
+            line += piece.lines;
+            instanceCount += piece.instances.size();
+        }
+        std::unordered_map<std::string, uint32_t> modelIndex;
+        for (Piece& piece : pieces) {
+            for (SceneModel& model : piece.models) {
+                if (!modelIndex.emplace(model.name, (uint32_t)out.models.size()).second) {
+                    if (error)
+                        *error = "model " + model.name + " named twice";
+                    return false;
+                }
+                out.models.push_back(std::move(model));
+            }
+            out.lights.insert(out.lights.end(), piece.lights.begin(), piece.lights.end());
+        }
+        // instances of one model tend to come in runs, the last lookup is usually the next one too
+        out.instances.reserve(instanceCount);
+        std::string lastName;
+        uint32_t lastModel = 0;
+        for (Piece& piece : pieces) {
+            for (size_t i = 0; i < piece.instances.size(); ++i) {
+                const std::pair<const char*, size_t>& name = piece.instanceModels[i];
+                if (lastName.size() != name.second || std::memcmp(lastName.data(), name.first, name.second) != 0) {
+                    lastName.assign(name.first, name.second);
+                    auto found = modelIndex.find(lastName);
+                    if (found == modelIndex.end()) {
+                        if (error)
+                            *error = "instance of unknown model " + lastName;
+                        return false;
+                    }
+                    lastModel = found->second;
+                }
+                SceneInstance instance = piece.instances[i];
+                instance.model = lastModel;
+                if (instance.parent != kNoParent &&
+                    (instance.parent >= instanceCount || instance.parent == out.instances.size())) {
+                    if (error)
+                        *error = "instance " + std::to_string(out.instances.size()) + " has no parent " +
+                                 std::to_string(instance.parent);
+                    return false;
+                }
+                out.instances.push_back(instance);
+            }
+        }
+        return true;
+    }
+
+    static bool parseBinary(const unsigned char* data, size_t size, SceneDescription& out, std::string* error) {
+        const unsigned char* p = data;
+        const unsigned char* end = data + size;
+        auto truncated = [error] {
+            if (error)
+                *error = "truncated binary scene";
+            return false;
+        };
+        if (size < kHeaderSize)
+            return truncated();
+        uint32_t magic = readValue<uint32_t>(p);
+        uint32_t version = readValue<uint32_t>(p);
+        uint32_t modelCount = readValue<uint32_t>(p);
+        uint32_t instanceCount = readValue<uint32_t>(p);
+        uint32_t lightCount = readValue<uint32_t>(p);
+        readValue<uint32_t>(p);
+        if (magic != kMagic || version != kVersion) {
+            if (error)
+                *error = "not a binary scene of version " + std::to_string(kVersion);
+            return false;
+        }
+        out = SceneDescription();
+        out.models.resize(modelCount);
+        for (SceneModel& model : out.models) {
+            for (std::string* text : {&model.name, &model.path}) {
+                if ((size_t)(end - p) < 2)
+                    return truncated();
+                uint16_t length = readValue<uint16_t>(p);
+                if ((size_t)(end - p) < length)
+                    return truncated();
+                text->assign((const char*)p, length);
+                p += length;
+            }
+        }
+        if ((size_t)(end - p) < (size_t)instanceCount * sizeof(SceneInstance) + (size_t)lightCount * kLightSize)
+            return truncated();
+        out.instances.resize(instanceCount);
+        if (instanceCount)
+            std::memcpy(out.instances.data(), p, instanceCount * sizeof(SceneInstance));
+        p += instanceCount * sizeof(SceneInstance);
+        for (const SceneInstance& instance : out.instances) {
+            if (instance.model >= modelCount || (instance.parent != kNoParent && instance.parent >= instanceCount)) {
+                if (error)
+                    *error = "instance with an unknown model or parent";
+                return false;
+            }
+        }
+        out.lights.resize(lightCount);
+        for (SceneLight& light : out.lights) {
+            light.source.slot = readValue<int32_t>(p);
+            readFloats(p, &light.position.x, 3);
+            readColor(p, light.source.point);
+            readColor(p, light.source.spot);
+            readFloats(p, &light.source.spotDirection.x, 3);
+            readFloats(p, &light.source.spotCutOff.x, 2);
+        }
+        return true;
+    }
+
+    // either form, told apart by the binary magic; read through Resources, so scenes can be packed
+    static bool load(const std::string& path, SceneDescription& out, std::string* error) {
+        ResourceData data;
+        if (!Resources::read(path, data)) {
+            if (error)
+                *error = "cannot read " + path;
+            return false;
+        }
+        uint32_t magic = 0;
+        if (data.size >= sizeof(magic))
+            std::memcpy(&magic, data.data, sizeof(magic));
+        bool parsed = magic == kMagic ? parseBinary(data.data, data.size, out, error)
+                                      : parseText((const char*)data.data, data.size, out, error);
+        if (!parsed && error)
+            *error = path + ": " + *error;
+        return parsed;
+    }
+
+    static bool writeText(const std::string& path, const SceneDescription& scene, std::string* error) {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out) {
+            if (error) *error = "cannot create " + path;
+            return false;
+        }
+        out << std::setprecision(9);
+        for (const SceneModel& model : scene.models)
+            out << "model " << model.name << ' ' << model.path << '\n';
+        for (const SceneInstance& instance : scene.instances) {
+            out << "instance " << scene.models[instance.model].name;
+            for (const glm::vec3& value : {instance.position, instance.rotation, instance.scale})
+                out << "  " << value.x << ' ' << value.y << ' ' << value.z;
+            if (instance.flags & kCastsShadow) out << " shadow";
+            if (instance.flags & kOccluder) out << " occluder";
+            if (instance.flags & kInstanced) out << " instanced";
+            if (instance.parent != kNoParent) out << " parent " << instance.parent;
+            out << '\n';
+        }
+        for (const SceneLight& light : scene.lights) {
+            const LightSource& source = light.source;
+            out << "light " << source.slot << "  " << light.position.x << ' ' << light.position.y << ' '
+                << light.position.z << "  point";
+            printColor(out, source.point);
+            out << "  spot  " << source.spotDirection.x << ' ' << source.spotDirection.y << ' '
+                << source.spotDirection.z;
+            printColor(out, source.spot);
+            out << "  " << source.spotCutOff.x << ' ' << source.spotCutOff.y << '\n';
+        }
+        if (!out) {
+            if (error) *error = "write to " + path + " failed";
+            return false;
+        }
+        return true;
+    }
+
+    static bool writeBinary(const std::string& path, const SceneDescription& scene, std::string* error) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            if (error) *error = "cannot create " + path;
+            return false;
+        }
+        writeValue<uint32_t>(out, kMagic);
+        writeValue<uint32_t>(out, kVersion);
+        writeValue<uint32_t>(out, (uint32_t)scene.models.size());
+        writeValue<uint32_t>(out, (uint32_t)scene.instances.size());
+        writeValue<uint32_t>(out, (uint32_t)scene.lights.size());
+        writeValue<uint32_t>(out, 0);
+        for (const SceneModel& model : scene.models) {
+            for (const std::string* text : {&model.name, &model.path}) {
+                if (text->size() > 0xFFFF) {
+                    if (error) *error = "model path too long: " + *text;
+                    return false;
+                }
+                writeValue<uint16_t>(out, (uint16_t)text->size());
+                out.write(text->data(), text->size());
+            }
+        }
+        out.write((const char*)scene.instances.data(), scene.instances.size() * sizeof(SceneInstance));
+        for (const SceneLight& light : scene.lights) {
+            writeValue<int32_t>(out, light.source.slot);
+            writeFloats(out, &light.position.x, 3);
+            writeColor(out, light.source.point);
+            writeColor(out, light.source.spot);
+            writeFloats(out, &light.source.spotDirection.x, 3);
+            writeFloats(out, &light.source.spotCutOff.x, 2);
+        }
+        if (!out) {
+            if (error) *error = "write to " + path + " failed";
+            return false;
+        }
+        return true;
+    }
+};
+
+// an entity per light of the description
+inline void instantiateLights(const SceneDescription& description, Scene& scene) {
+    for (const SceneLight& light : description.lights) {
+        Entity entity = scene.create();
+        scene.transforms.add(entity, light.position);
+        scene.lights.add(entity, light.source);
+    }
+}
+
+}
+#endif //PROJECT_BASE_SCENEFILE_H
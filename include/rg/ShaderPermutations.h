@@ -0,0 +1,155 @@
+#ifndef PROJECT_BASE_SHADERPERMUTATIONS_H
+#define PROJECT_BASE_SHADERPERMUTATIONS_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <learnopengl/shader.h>
+#include <rg/GLState.h>
+
+namespace rg {
+
+// Bits of a permutation key. Material bits come from the mesh, the rest from the frame settings; a key is the
+// two or'ed together and maps to exactly one set of #defines.
+enum ShaderFeature : uint32_t {
+    FeatureShadows = 1u << 0,
+    FeatureSpecularMap = 1u << 1,
+    FeatureNormalMap = 1u << 2,
+    FeatureInstanced = 1u << 3,
+};
+
+const uint32_t kMaterialFeatureMask = FeatureSpecularMap | FeatureNormalMap;
+const int kPcfShift = 4;
+const int kPointLightShift = 8;
+const int kSpotLightShift = 12;
+
+enum class PcfQuality : uint32_t {
+    Low,
+    Medium,
+    High,
+};
+
+// filter taps per axis, the shadow lookup takes the cube of this
+inline int pcfSamples(PcfQuality quality) {
+    switch (quality) {
+        case PcfQuality::Low: return 3;
+        case PcfQuality::Medium: return 5;
+        default: return 10;
+    }
+}
+
+inline uint32_t frameFeatures(bool shadows, PcfQuality pcf, int pointLights, int spotLights) {
+    uint32_t key = shadows ? FeatureShadows : 0u;
+    if (shadows)
+        key |= (uint32_t)pcf << kPcfShift; // PCF quality is irrelevant without shadows
+    key |= (uint32_t)(pointLights & 0xF) << kPointLightShift;
+    key |= (uint32_t)(spotLights & 0xF) << kSpotLightShift;
+    return key;
+}
+
+inline uint32_t materialFeatures(bool specularMap, bool normalMap) {
+    return (specularMap ? FeatureSpecularMap : 0u) | (normalMap ? FeatureNormalMap : 0u);
+}
+
+inline std::string featureDefines(uint32_t key) {
+    std::string defines;
+    defines += "#define NUM_POINT_LIGHTS " + std::to_string((key >> kPointLightShift) & 0xF) + "\n";
+    defines += "#define NUM_SPOT_LIGHTS " + std::to_string((key >> kSpotLightShift) & 0xF) + "\n";
+    if (key & FeatureShadows) {
+        defines += "#define SHADOWS\n";
+        defines += "#define PCF_SAMPLES " + std::to_string(pcfSamples((PcfQuality)((key >> kPcfShift) & 0xF))) + "\n";
+    }
+    if (key & FeatureSpecularMap)
+        defines += "#define HAS_SPECULAR_MAP\n";
+    if (key & FeatureNormalMap)
+        defines += "#define HAS_NORMAL_MAP\n";
+    if (key & FeatureInstanced)
+        defines += "#define INSTANCED\n";
+    return defines;
+}
+
+// Specialized variants of one program, compiled on first use (or ahead of it with prepare()) from the same sources
+// with the key's #defines and kept for the rest of the run (and across runs through the program binary cache).
+class ShaderPermutations {
+    std::string m_VertexPath;
+    std::string m_FragmentPath;
+    std::string m_GeometryPath;
+    std::unordered_map<uint32_t, std::unique_ptr<Shader>> m_Variants;
+    std::unordered_set<uint32_t> m_Prepared; // submitted by prepare(), not finished yet
+    std::function<void(Shader&)> m_Setup;
+
+public:
+    ShaderPermutations(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+            : m_VertexPath(vertexPath), m_FragmentPath(fragmentPath), m_GeometryPath(geometryPath ? geometryPath : "") {}
+
+    // runs on every new variant with the variant bound, for uniforms that never change (samplers, constants)
+    void onCreate(std::function<void(Shader&)> setup) {
+        m_Setup = std::move(setup);
+    }
+
+    // starts compiling a variant that will be needed soon without waiting for it, see ShaderBuild::Deferred
+    void prepare(uint32_t key) {
+        if (m_Variants.count(key))
+            return;
+        m_Variants.emplace(key, create(key, ShaderBuild::Deferred));
+        m_Prepared.insert(key);
+    }
+
+    // finishes every prepared variant, the ones the driver is done with first
+    void finishPrepared() {
+        while (!m_Prepared.empty()) {
+            auto next = m_Prepared.begin();
+            for (auto it = m_Prepared.begin(); it != m_Prepared.end(); ++it)
+                if (m_Variants[*it]->isReady()) {
+                    next = it;
+                    break;
+                }
+            uint32_t key = *next;
+            m_Prepared.erase(next);
+            setUp(*m_Variants[key]);
+        }
+    }
+
+    Shader& get(uint32_t key) {
+        auto it = m_Variants.find(key);
+        if (it != m_Variants.end()) {
+            if (m_Prepared.erase(key))
+                setUp(*it->second);
+            return *it->second;
+        }
+        std::unique_ptr<Shader> shader = create(key, ShaderBuild::Immediate);
+        Shader& variant = *shader;
+        m_Variants.emplace(key, std::move(shader));
+        setUp(variant);
+        return variant;
+    }
+
+    // binds the variant; true if it was not the bound program already (GLState drops the redundant binds)
+    bool use(uint32_t key, Shader*& variant) {
+        variant = &get(key);
+        return GLState::useProgram(variant->ID);
+    }
+
+    size_t variantCount() const { return m_Variants.size(); }
+
+private:
+    std::unique_ptr<Shader> create(uint32_t key, ShaderBuild build) const {
+        return std::unique_ptr<Shader>(new Shader(m_VertexPath.c_str(), m_FragmentPath.c_str(),
+                                                  m_GeometryPath.empty() ? nullptr : m_GeometryPath.c_str(),
+                                                  featureDefines(key), build));
+    }
+
+    void setUp(Shader& variant) {
+        variant.finish();
+        if (m_Setup) {
+            variant.use();
+            m_Setup(variant);
+        }
+    }
+};
+
+}
+#endif //PROJECT_BASE_SHADERPERMUTATIONS_H
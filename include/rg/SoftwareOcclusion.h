@@ -0,0 +1,273 @@
+#ifndef PROJECT_BASE_SOFTWAREOCCLUSION_H
+#define PROJECT_BASE_SOFTWAREOCCLUSION_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/mesh.h>
+#include <rg/Bounds.h>
+#include <rg/FrustumCulling.h>
+#include <rg/ThreadPool.h>
+
+namespace rg {
+
+// Triangles of a model standing in for it in the software depth buffer, three model space corners each.
+struct OccluderMesh {
+    std::vector<glm::vec3> corners;
+
+    size_t triangles() const { return corners.size() / 3; }
+};
+
+// the largest triangles of the opaque meshes, at most maxTriangles of them. A subset of the real surface can only
+// hide less than the model does, so dropping the small ones never makes anything disappear that should be seen.
+inline OccluderMesh selectOccluder(const std::vector<Mesh>& meshes, size_t maxTriangles) {
+    std::vector<std::pair<float, size_t>> areas;
+    std::vector<glm::vec3> corners;
+    for (const Mesh& mesh : meshes) {
+        if (mesh.transparent)
+            continue;
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            glm::vec3 a = mesh.vertices[mesh.indices[i]].Position;
+            glm::vec3 b = mesh.vertices[mesh.indices[i + 1]].Position;
+            glm::vec3 c = mesh.vertices[mesh.indices[i + 2]].Position;
+            areas.push_back({glm::length(glm::cross(b - a, c - a)), corners.size()});
+            corners.push_back(a);
+            corners.push_back(b);
+            corners.push_back(c);
+        }
+    }
+    if (areas.size() > maxTriangles) {
+        std::nth_element(areas.begin(), areas.begin() + maxTriangles, areas.end(),
+                         [](const std::pair<float, size_t>& x, const std::pair<float, size_t>& y) { return x.first > y.first; });
+        areas.resize(maxTriangles);
+    }
+    OccluderMesh occluder;
+    occluder.corners.reserve(areas.size() * 3);
+    for (const std::pair<float, size_t>& triangle : areas)
+        occluder.corners.insert(occluder.corners.end(), &corners[triangle.second], &corners[triangle.second] + 3);
+    return occluder;
+}
+
+// Occlusion culling on the CPU: a few large occluders are rasterized into a small depth buffer, then the boxes of
+// the objects in view are tested against it. The buffer holds 1/w, which interpolates linearly across the screen,
+// cleared to 0 (infinitely far) and kept at the nearest occluder; a box is hidden if every pixel under its screen
+// rectangle holds an occluder nearer than the box's nearest corner.
+//
+// rasterize() hands the work to the shared thread pool and returns at once, the caller goes on with the rest of the
+// frame's culling and test() waits for it. Rows are split in bands between the workers, each band is filled four
+// pixels at a time with SSE (scalar where SSE is missing).
+class SoftwareOcclusion {
+    struct ScreenTriangle {
+        glm::vec3 edges[3]; // a * x + b * y + c, >= 0 inside
+        glm::vec3 depth;    // 1/w as a plane over the screen
+        int minX, maxX, minY, maxY; // pixel rectangle, max exclusive
+    };
+
+    static const int kBandRows = 8;
+
+    int m_Width, m_Height;
+    std::vector<float> m_Depth;
+    glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+    std::vector<std::pair<const OccluderMesh*, glm::mat4>> m_Occluders;
+    std::vector<ScreenTriangle> m_Triangles;
+    std::future<void> m_Pending;
+    double m_RasterMilliseconds = 0.0;
+    size_t m_TrianglesDrawn = 0;
+
+    glm::vec3 toScreen(const glm::vec4& clip) const {
+        float invW = 1.0f / clip.w;
+        return glm::vec3((clip.x * invW * 0.5f + 0.5f) * (float)m_Width, (clip.y * invW * 0.5f + 0.5f) * (float)m_Height, invW);
+    }
+
+    void setupTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2) {
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        if (area < 0.0f) {
+            std::swap(v1, v2); // occluders are drawn from both sides
+            area = -area;
+        }
+        ScreenTriangle triangle;
+        triangle.minX = std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))));
+        triangle.maxX = std::min(m_Width, (int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x))));
+        triangle.minY = std::max(0, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))));
+        triangle.maxY = std::min(m_Height, (int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y))));
+        if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY)
+            return;
+        const glm::vec3* corners[3] = {&v0, &v1, &v2};
+        for (int e = 0; e < 3; ++e) {
+            const glm::vec3& a = *corners[e];
+            const glm::vec3& b = *corners[(e + 1) % 3];
+            triangle.edges[e] = glm::vec3(a.y - b.y, b.x - a.x, a.x * b.y - a.y * b.x);
+        }
+        float dx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+        float dy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+        triangle.depth = glm::vec3(dx, dy, v0.z - dx * v0.x - dy * v0.y);
+        m_Triangles.push_back(triangle);
+    }
+
+    // clips against the near plane (z >= -w) and sets up what is left, a triangle or a quad
+    void clipTriangle(const glm::vec4* clip) {
+        bool outside = true;
+        for (int axis = 0; axis < 2 && outside; ++axis) {
+            outside = (clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w) ||
+                      (clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w);
+        }
+        if (outside)
+            return;
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec4& a = clip[i];
+            const glm::vec4& b = clip[(i + 1) % 3];
+            float da = a.z + a.w, db = b.z + b.w;
+            if (da >= 0.0f)
+                polygon[count++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                polygon[count++] = a + (b - a) * (da / (da - db));
+        }
+        if (count < 3)
+            return;
+        glm::vec3 first = toScreen(polygon[0]);
+        for (int i = 1; i + 1 < count; ++i)
+            setupTriangle(first, toScreen(polygon[i]), toScreen(polygon[i + 1]));
+    }
+
+    void rasterizeRows(int rowBegin, int rowEnd) {
+        std::fill(m_Depth.begin() + rowBegin * m_Width, m_Depth.begin() + rowEnd * m_Width, 0.0f);
+        for (const ScreenTriangle& triangle : m_Triangles) {
+            int y0 = std::max(triangle.minY, rowBegin), y1 = std::min(triangle.maxY, rowEnd);
+            int x0 = triangle.minX & ~3, x1 = triangle.maxX;
+            const glm::vec3 *edges = triangle.edges, &depth = triangle.depth;
+            for (int y = y0; y < y1; ++y) {
+                float py = (float)y + 0.5f;
+                float* row = &m_Depth[(size_t)y * m_Width];
+#ifdef RG_CULL_SSE
+                const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f), zero = _mm_setzero_ps();
+                __m128 a0 = _mm_set1_ps(edges[0].x), a1 = _mm_set1_ps(edges[1].x), a2 = _mm_set1_ps(edges[2].x);
+                __m128 r0 = _mm_set1_ps(edges[0].y * py + edges[0].z);
+                __m128 r1 = _mm_set1_ps(edges[1].y * py + edges[1].z);
+                __m128 r2 = _mm_set1_ps(edges[2].y * py + edges[2].z);
+                __m128 dx = _mm_set1_ps(depth.x), dr = _mm_set1_ps(depth.y * py + depth.z);
+                for (int x = x0; x < x1; x += 4) {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                    __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+                                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero),
+                                               _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero)));
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearest = _mm_max_ps(old, _mm_add_ps(_mm_mul_ps(dx, px), dr));
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+                }
+#else
+                for (int x = x0; x < x1; ++x) {
+                    float px = (float)x + 0.5f;
+                    if (edges[0].x * px + edges[0].y * py + edges[0].z < 0.0f ||
+                        edges[1].x * px + edges[1].y * py + edges[1].z < 0.0f ||
+                        edges[2].x * px + edges[2].y * py + edges[2].z < 0.0f)
+                        continue;
+                    row[x] = std::max(row[x], depth.x * px + depth.y * py + depth.z);
+                }
+#endif
+            }
+        }
+    }
+
+    void run() {
+        auto start = std::chrono::steady_clock::now();
+        m_Triangles.clear();
+        glm::vec4 clip[3];
+        for (const std::pair<const OccluderMesh*, glm::mat4>& occluder : m_Occluders) {
+            glm::mat4 transform = m_ViewProjection * occluder.second;
+            const std::vector<glm::vec3>& corners = occluder.first->corners;
+            for (size_t i = 0; i + 2 < corners.size(); i += 3) {
+                for (int k = 0; k < 3; ++k)
+                    clip[k] = transform * glm::vec4(corners[i + k], 1.0f);
+                clipTriangle(clip);
+            }
+        }
+        int bands = (m_Height + kBandRows - 1) / kBandRows;
+        ThreadPool::shared().parallelFor((size_t)bands, 1, [this](size_t begin, size_t end) {
+            rasterizeRows((int)begin * kBandRows, std::min(m_Height, (int)end * kBandRows));
+        });
+        m_TrianglesDrawn = m_Triangles.size();
+        m_RasterMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void wait() {
+        if (m_Pending.valid())
+            m_Pending.get();
+    }
+
+public:
+    // width is rounded up to a multiple of four, the SIMD loop then never runs past a row
+    explicit SoftwareOcclusion(int width = 256, int height = 128)
+            : m_Width((width + 3) & ~3), m_Height(height), m_Depth((size_t)m_Width * height, 0.0f) {}
+
+    ~SoftwareOcclusion() { wait(); }
+
+    SoftwareOcclusion(const SoftwareOcclusion&) = delete;
+    SoftwareOcclusion& operator=(const SoftwareOcclusion&) = delete;
+
+    // starts drawing the occluders, each with its model matrix; the meshes have to live until test() returns
+    void rasterize(const glm::mat4& viewProjection, const std::vector<std::pair<const OccluderMesh*, glm::mat4>>& occluders) {
+        wait();
+        m_ViewProjection = viewProjection;
+        m_Occluders = occluders;
+        m_Pending = ThreadPool::shared().submit([this] { run(); });
+    }
+
+    // clears visible[i] of every visible box the occluders hide, returns how many. Boxes reaching through the near
+    // plane are never hidden, neither are empty ones.
+    size_t test(const std::vector<Aabb>& bounds, std::vector<uint8_t>& visible) {
+        wait();
+        size_t hidden = 0;
+        for (size_t i = 0; i < bounds.size(); ++i) {
+            const Aabb& box = bounds[i];
+            if (!visible[i] || box.empty())
+                continue;
+            float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = 0.0f;
+            bool crossesNear = false;
+            for (int corner = 0; corner < 8 && !crossesNear; ++corner) {
+                glm::vec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                                (corner & 4) ? box.max.z : box.min.z);
+                glm::vec4 clip = m_ViewProjection * glm::vec4(point, 1.0f);
+                crossesNear = clip.z < -clip.w;
+                glm::vec3 screen = toScreen(clip);
+                minX = std::min(minX, screen.x); maxX = std::max(maxX, screen.x);
+                minY = std::min(minY, screen.y); maxY = std::max(maxY, screen.y);
+                nearest = std::max(nearest, screen.z);
+            }
+            if (crossesNear)
+                continue;
+            int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(m_Width, (int)std::ceil(maxX));
+            int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(m_Height, (int)std::ceil(maxY));
+            if (x0 >= x1 || y0 >= y1)
+                continue;
+            bool covered = true;
+            for (int y = y0; y < y1 && covered; ++y) {
+                const float* row = &m_Depth[(size_t)y * m_Width];
+                for (int x = x0; x < x1 && covered; ++x)
+                    covered = row[x] > nearest;
+            }
+            if (covered) {
+                visible[i] = 0;
+                ++hidden;
+            }
+        }
+        return hidden;
+    }
+
+    // time the last rasterize() took on the workers, setup included
+    double rasterMilliseconds() const { return m_RasterMilliseconds; }
+    size_t trianglesDrawn() const { return m_TrianglesDrawn; }
+};
+
+}
+#endif //PROJECT_BASE_SOFTWAREOCCLUSION_H
@@ -0,0 +1,151 @@
+#ifndef PROJECT_BASE_TANGENTSPACE_H
+#define PROJECT_BASE_TANGENTSPACE_H
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <glm/glm.hpp>
+#include <rg/ThreadPool.h>
+
+namespace rg {
+
+// Vertex streams the tangent generator reads, each one strided so interleaved and planar layouts both work.
+struct TangentInput {
+    const unsigned char* positions;
+    size_t positionStride;
+    const unsigned char* normals;
+    size_t normalStride;
+    const unsigned char* texCoords;
+    size_t texCoordStride;
+    size_t vertexCount;
+};
+
+namespace detail {
+    template<typename T>
+    T fetch(const unsigned char* base, size_t stride, size_t index) {
+        T value;
+        std::memcpy(&value, base + stride * index, sizeof(T));
+        return value;
+    }
+
+    inline glm::vec3 projectOnPlane(const glm::vec3& v, const glm::vec3& normal) {
+        glm::vec3 projected = v - normal * glm::dot(normal, v);
+        float length = glm::length(projected);
+        return length > 1e-20f ? projected / length : glm::vec3(0.0f);
+    }
+
+    // any unit vector perpendicular to n, for vertices whose triangles give no usable UV direction
+    inline glm::vec3 anyPerpendicular(const glm::vec3& n) {
+        glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        return glm::normalize(glm::cross(n, axis));
+    }
+}
+
+// Per vertex tangents in the MikkTSpace convention: xyz is the tangent, w the handedness, and the bitangent is
+// reconstructed as cross(normal, tangent.xyz) * tangent.w. Like MikkTSpace, corner contributions are projected onto
+// the vertex normal plane and weighted by the corner angle, and vertices shared by triangles of opposite UV winding
+// are split so mirrored UV seams get their own handedness. MikkTSpace's finer grouping of sharp corners is not done.
+//
+// Triangles and vertices are processed in parallel on the shared pool. When splitVertices is set, indices are
+// rewritten to reference appended vertices and splitSources receives, for every appended vertex, the vertex it copies.
+inline std::vector<glm::vec4> generateTangents(const TangentInput& input, std::vector<unsigned int>& indices,
+                                               bool splitVertices, std::vector<unsigned int>* splitSources) {
+    ThreadPool& pool = ThreadPool::shared();
+    const size_t triangleCount = indices.size() / 3;
+    const size_t kChunk = 4096;
+
+    // 1. face tangent frame, orientation and angle weighted corner contributions
+    std::vector<glm::vec3> cornerTangents(triangleCount * 3);
+    std::vector<glm::vec3> cornerBitangents(triangleCount * 3);
+    std::vector<signed char> orientation(triangleCount, 1);
+    pool.parallelFor(triangleCount, kChunk, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            unsigned int v[3] = {indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]};
+            glm::vec3 p[3];
+            glm::vec2 uv[3];
+            for (int c = 0; c < 3; ++c) {
+                p[c] = detail::fetch<glm::vec3>(input.positions, input.positionStride, v[c]);
+                uv[c] = detail::fetch<glm::vec2>(input.texCoords, input.texCoordStride, v[c]);
+            }
+            glm::vec3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+            glm::vec2 d1 = uv[1] - uv[0], d2 = uv[2] - uv[0];
+            float signedArea = d1.x * d2.y - d2.x * d1.y;
+            orientation[t] = signedArea >= 0.0f ? 1 : -1;
+            if (std::fabs(signedArea) < 1e-20f)
+                continue; // no UV gradient, leave the corners zero
+            glm::vec3 sdir = (e1 * d2.y - e2 * d1.y) / signedArea;
+            glm::vec3 tdir = (e2 * d1.x - e1 * d2.x) / signedArea;
+            for (int c = 0; c < 3; ++c) {
+                glm::vec3 toNext = p[(c + 1) % 3] - p[c];
+                glm::vec3 toPrev = p[(c + 2) % 3] - p[c];
+                float lengths = glm::length(toNext) * glm::length(toPrev);
+                if (lengths <= 0.0f)
+                    continue;
+                float angle = std::acos(glm::clamp(glm::dot(toNext, toPrev) / lengths, -1.0f, 1.0f));
+                glm::vec3 n = detail::fetch<glm::vec3>(input.normals, input.normalStride, v[c]);
+                cornerTangents[3 * t + c] = detail::projectOnPlane(sdir, n) * angle;
+                cornerBitangents[3 * t + c] = detail::projectOnPlane(tdir, n) * angle;
+            }
+        }
+    });
+
+    // 2. split vertices used with both UV windings, the mirrored triangles move to the copy
+    size_t vertexCount = input.vertexCount;
+    std::vector<unsigned int> sources;
+    if (splitVertices) {
+        std::vector<unsigned char> windings(vertexCount, 0);
+        for (size_t corner = 0; corner < triangleCount * 3; ++corner)
+            windings[indices[corner]] |= orientation[corner / 3] > 0 ? 1 : 2;
+        std::vector<unsigned int> copyOf(vertexCount, 0);
+        for (size_t v = 0; v < input.vertexCount; ++v) {
+            if (windings[v] == 3) {
+                copyOf[v] = (unsigned int)vertexCount++;
+                sources.push_back((unsigned int)v);
+            }
+        }
+        for (size_t corner = 0; corner < triangleCount * 3; ++corner) {
+            unsigned int v = indices[corner];
+            if (windings[v] == 3 && orientation[corner / 3] < 0)
+                indices[corner] = copyOf[v];
+        }
+    }
+    auto sourceVertex = [&](size_t v) { return v < input.vertexCount ? v : (size_t)sources[v - input.vertexCount]; };
+
+    // 3. vertex -> corners adjacency, so vertices can be summed independently
+    std::vector<unsigned int> firstCorner(vertexCount + 1, 0);
+    for (size_t corner = 0; corner < triangleCount * 3; ++corner)
+        ++firstCorner[indices[corner] + 1];
+    for (size_t v = 0; v < vertexCount; ++v)
+        firstCorner[v + 1] += firstCorner[v];
+    std::vector<unsigned int> corners(triangleCount * 3);
+    std::vector<unsigned int> fill(firstCorner.begin(), firstCorner.end() - 1);
+    for (size_t corner = 0; corner < triangleCount * 3; ++corner)
+        corners[fill[indices[corner]]++] = (unsigned int)corner;
+
+    // 4. accumulate, orthonormalize against the normal and pick the handedness
+    std::vector<glm::vec4> tangents(vertexCount);
+    pool.parallelFor(vertexCount, kChunk, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            glm::vec3 tangent(0.0f), bitangent(0.0f);
+            for (unsigned int i = firstCorner[v]; i < firstCorner[v + 1]; ++i) {
+                tangent += cornerTangents[corners[i]];
+                bitangent += cornerBitangents[corners[i]];
+            }
+            glm::vec3 n = detail::fetch<glm::vec3>(input.normals, input.normalStride, sourceVertex(v));
+            float length = glm::length(n);
+            n = length > 0.0f ? n / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            tangent = detail::projectOnPlane(tangent, n);
+            if (tangent == glm::vec3(0.0f))
+                tangent = detail::anyPerpendicular(n);
+            float handedness = glm::dot(glm::cross(n, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+            tangents[v] = glm::vec4(tangent, handedness);
+        }
+    });
+
+    if (splitSources)
+        *splitSources = std::move(sources);
+    return tangents;
+}
+
+}
+#endif //PROJECT_BASE_TANGENTSPACE_H
@@ -0,0 +1,32 @@
+#ifndef PROJECT_BASE_TEXTUREUNITS_H
+#define PROJECT_BASE_TEXTUREUNITS_H
+
+#include <glad/glad.h>
+#include <rg/GLState.h>
+
+namespace rg {
+
+// Texture unit layout shared by the meshes and the render loop. Material samplers get fixed units per role
+// (see Mesh), so a program's sampler uniforms never change after they are first set.
+const GLuint kMaterialTexturesPerRole = 2;
+const GLuint kMaterialTextureUnits = 8;
+const GLuint kShadowMapUnit = 8;
+const GLuint kDepthPyramidUnit = 9;
+
+// Material textures go through the GL state cache, so repeated binds of the same texture are skipped. Code that
+// binds 2D textures directly (texture loading, framebuffer setup) must call invalidate() before the tracked binds
+// are relied on again.
+class TextureUnits {
+public:
+    // true if the binding changed
+    static bool bind2D(GLuint unit, GLuint texture) {
+        return GLState::bindTexture(unit, GL_TEXTURE_2D, texture);
+    }
+
+    static void invalidate() {
+        GLState::invalidate();
+    }
+};
+
+}
+#endif //PROJECT_BASE_TEXTUREUNITS_H
@@ -0,0 +1,120 @@
+#ifndef PROJECT_BASE_THREADPOOL_H
+#define PROJECT_BASE_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rg {
+
+// Fixed set of worker threads fed from one queue. Used for decoding and other load-time work
+// that must stay off the thread owning the GL context.
+class ThreadPool {
+    std::vector<std::thread> m_Workers;
+    std::deque<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    bool m_Stopping = false;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Wake.wait(lock, [this] { return m_Stopping || !m_Tasks.empty(); });
+                if (m_Stopping && m_Tasks.empty())
+                    return;
+                task = std::move(m_Tasks.front());
+                m_Tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned threadCount = std::max(1u, std::thread::hardware_concurrency())) {
+        for (unsigned i = 0; i < threadCount; ++i)
+            m_Workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stopping = true;
+        }
+        m_Wake.notify_all();
+        for (std::thread& worker : m_Workers)
+            worker.join();
+    }
+
+    size_t size() const { return m_Workers.size(); }
+
+    template<typename F>
+    auto submit(F&& f) -> std::future<decltype(f())> {
+        // std::function needs a copyable target, packaged_task is move only
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+        std::future<decltype(f())> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tasks.emplace_back([task] { (*task)(); });
+        }
+        m_Wake.notify_one();
+        return result;
+    }
+
+    // calls body(begin, end) over [0, count) split into chunks of at least minChunk items and waits for all of them.
+    // The calling thread takes chunks as well, so this is safe to call from a worker.
+    void parallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& body) {
+        if (count == 0)
+            return;
+        size_t chunkCount = std::min((count + minChunk - 1) / std::max<size_t>(minChunk, 1), size() + 1);
+        if (chunkCount <= 1) {
+            body(0, count);
+            return;
+        }
+        struct Progress {
+            std::atomic<size_t> next{0};
+            size_t done = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        auto progress = std::make_shared<Progress>();
+        // helpers that start after every chunk was claimed return without touching body,
+        // so we only wait for claimed chunks and never for queued helpers
+        auto runChunks = [progress, chunkSize, count, &body] {
+            size_t begin;
+            while ((begin = progress->next.fetch_add(chunkSize)) < count) {
+                size_t end = std::min(begin + chunkSize, count);
+                body(begin, end);
+                std::lock_guard<std::mutex> lock(progress->mutex);
+                progress->done += end - begin;
+                if (progress->done == count)
+                    progress->finished.notify_all();
+            }
+        };
+        for (size_t i = 1; i < chunkCount; ++i)
+            submit(runChunks);
+        runChunks();
+        std::unique_lock<std::mutex> lock(progress->mutex);
+        progress->finished.wait(lock, [&] { return progress->done == count; });
+    }
+
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+};
+
+}
+#endif //PROJECT_BASE_THREADPOOL_H
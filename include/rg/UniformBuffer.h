@@ -0,0 +1,150 @@
+#ifndef PROJECT_BASE_UNIFORMBUFFER_H
+#define PROJECT_BASE_UNIFORMBUFFER_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+namespace rg {
+
+// Binding points of the uniform blocks shared by all programs.
+enum UniformBinding : GLuint {
+    CameraBinding = 0,
+    LightsBinding = 1,
+};
+
+// CPU mirrors of the std140 blocks. Every member is 4 byte based and padding is spelled out, so a value initialized
+// block has no indeterminate bytes and can be compared with memcmp.
+
+// layout (std140) uniform Camera
+struct CameraUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPosition;
+    float padding0;
+};
+static_assert(sizeof(CameraUniforms) == 144, "CameraUniforms must match the std140 layout");
+
+const int kNumLights = 3;
+
+// std140 packs a float right behind a vec3; a struct is rounded up to 16 bytes
+struct GpuPointLight {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 ambient;
+    float linear;
+    glm::vec3 diffuse;
+    float quadratic;
+    glm::vec3 specular;
+    float padding0;
+};
+static_assert(sizeof(GpuPointLight) == 64, "GpuPointLight must match the std140 layout");
+
+struct GpuSpotLight {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 direction;
+    float linear;
+    glm::vec3 ambient;
+    float quadratic;
+    glm::vec3 diffuse;
+    float cutOff;
+    glm::vec3 specular;
+    float outerCutOff;
+};
+static_assert(sizeof(GpuSpotLight) == 80, "GpuSpotLight must match the std140 layout");
+
+// layout (std140) uniform Lights
+struct LightUniforms {
+    GpuPointLight pointLight[kNumLights];
+    GpuSpotLight spotLight[kNumLights];
+};
+
+inline GpuPointLight makePointLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular,
+                                    float constant, float linear, float quadratic) {
+    GpuPointLight light{};
+    light.position = position;
+    light.ambient = ambient;
+    light.diffuse = diffuse;
+    light.specular = specular;
+    light.constant = constant;
+    light.linear = linear;
+    light.quadratic = quadratic;
+    return light;
+}
+
+// distance at which the point light's attenuation brings its brightest channel down to 5/256, beyond that it no
+// longer visibly lights anything
+inline float lightRange(const GpuPointLight& light) {
+    float brightest = 0.0f;
+    for (const glm::vec3& color : {light.ambient, light.diffuse, light.specular})
+        brightest = std::max(brightest, std::max(std::fabs(color.x), std::max(std::fabs(color.y), std::fabs(color.z))));
+    // 1 / (constant + linear d + quadratic d^2) * brightest = 5 / 256
+    float target = brightest * 256.0f / 5.0f - light.constant;
+    if (target <= 0.0f)
+        return 0.0f;
+    if (light.quadratic > 0.0f)
+        return (-light.linear + std::sqrt(light.linear * light.linear + 4.0f * light.quadratic * target)) / (2.0f * light.quadratic);
+    return light.linear > 0.0f ? target / light.linear : FLT_MAX;
+}
+
+inline GpuSpotLight makeSpotLight(glm::vec3 position, glm::vec3 direction, glm::vec3 ambient, glm::vec3 diffuse,
+                                  glm::vec3 specular, float constant, float linear, float quadratic,
+                                  float cutOff, float outerCutOff) {
+    GpuSpotLight light{};
+    light.position = position;
+    light.direction = direction;
+    light.ambient = ambient;
+    light.diffuse = diffuse;
+    light.specular = specular;
+    light.constant = constant;
+    light.linear = linear;
+    light.quadratic = quadratic;
+    light.cutOff = cutOff;
+    light.outerCutOff = outerCutOff;
+    return light;
+}
+
+// One uniform buffer bound to a fixed binding point. update() keeps a copy of the last upload and skips the
+// glBufferSubData when nothing changed, so data that is rebuilt every frame costs a memcmp in steady state.
+template<typename T>
+class UniformBuffer {
+    GLuint m_Buffer = 0;
+    T m_Uploaded{};
+    bool m_Valid = false;
+
+public:
+    explicit UniformBuffer(GLuint binding) {
+        glGenBuffers(1, &m_Buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, m_Buffer);
+    }
+
+    ~UniformBuffer() {
+        glDeleteBuffers(1, &m_Buffer);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    // true if the contents changed and were uploaded
+    bool update(const T& data) {
+        if (m_Valid && std::memcmp(&data, &m_Uploaded, sizeof(T)) == 0)
+            return false;
+        glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        m_Uploaded = data;
+        m_Valid = true;
+        return true;
+    }
+};
+
+}
+#endif //PROJECT_BASE_UNIFORMBUFFER_H
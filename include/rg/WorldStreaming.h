@@ -0,0 +1,474 @@
+#ifndef PROJECT_BASE_WORLDSTREAMING_H
+#define PROJECT_BASE_WORLDSTREAMING_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/model.h>
+#include <rg/Bounds.h>
+#include <rg/GLState.h>
+#include <rg/Scene.h>
+#include <rg/SceneFile.h>
+#include <rg/ThreadPool.h>
+
+namespace rg {
+
+// How much of the world is kept around the camera. cellSize is fixed when the world is partitioned, the rest is read
+// on every update.
+struct StreamingSettings {
+    float cellSize = 16.0f;                  // edge of the square cells the ground plane is split into
+    float loadRadius = 48.0f;                // cells closer than this on the ground plane are loaded
+    float unloadMargin = 8.0f;               // and unloaded once farther than loadRadius + unloadMargin
+    size_t memoryBudget = (size_t)512 << 20; // bytes of models, no new cells are started above it
+    size_t uploadBytesPerFrame = (size_t)32 << 20; // model bytes uploaded per frame, at least one model
+    size_t instancesPerFrame = 4096;         // entities created per frame, at least one cell
+};
+
+struct StreamingStats {
+    size_t cells = 0;
+    size_t residentCells = 0;
+    size_t loadingCells = 0;
+    size_t residentModels = 0;
+    size_t decodingModels = 0;
+    size_t residentBytes = 0;      // models decoded or uploaded
+    size_t pendingBytes = 0;       // estimated for the models being decoded, counted against the budget as well
+    size_t uploadedBytes = 0;      // by the last update
+    size_t createdEntities = 0;    // by the last update
+    size_t destroyedEntities = 0;  // by the last update
+};
+
+// Streams the instances of a scene description into a Scene around the camera. The instances are split into cells
+// of the ground plane by the position of their root (children stay with their parent's cell). A cell in range
+// starts loading its models: they are decoded on the shared pool (Model::Decode), uploaded on the GL thread within a
+// per frame byte limit and the cell's entities are created once all of them are resident. Cells out of range lose
+// their entities at once; their models stay cached until the memory budget needs the room, least recently used
+// first.
+//
+// models[i] is description model i, an empty Model while it is not resident. An entity only exists while its model
+// is resident, so everything the renderables point at can be drawn. Lights are not streamed.
+class WorldStreamer {
+    enum class CellState : uint8_t { Unloaded, Loading, Resident };
+
+    struct Cell {
+        int x;
+        int z;
+        std::vector<uint32_t> instances; // into the description
+        std::vector<uint32_t> models;    // distinct models of the instances
+        std::vector<Entity> entities;    // while resident, one per instance
+        CellState state = CellState::Unloaded;
+    };
+
+    enum class ModelState : uint8_t { Unloaded, Decoding, Decoded, Resident };
+
+    struct ModelSlot {
+        ModelState state = ModelState::Unloaded;
+        uint32_t users = 0;    // cells loading or resident that place the model
+        uint64_t lastUsed = 0; // update that dropped the last user
+        std::future<Model> decoding;
+        Model decoded;
+        size_t bytes = 0;        // while decoded or resident
+        size_t estimate = 0;     // counted for it while decoding
+        size_t measured = 0;     // its size when it was last read, 0 if never
+    };
+
+    const SceneDescription& m_Description;
+    std::vector<Model>& m_Models;
+    Scene& m_Scene;
+    float m_CellSize;
+    std::vector<Cell> m_Cells;
+    std::unordered_map<uint64_t, uint32_t> m_Grid; // cell coordinates -> cell
+    std::vector<uint32_t> m_CellOf;     // by instance
+    std::vector<uint32_t> m_LocalIndex; // by instance, position in its cell's instances
+    std::vector<uint32_t> m_Active;     // cells loading or resident
+    std::vector<ModelSlot> m_Slots;
+    std::deque<uint32_t> m_Uploads;     // decoded models, in the order their cells asked for them
+    std::vector<Aabb> m_ModelBounds;
+    size_t m_ResidentBytes = 0;
+    size_t m_PendingBytes = 0;  // estimated size of the models being decoded
+    size_t m_MeasuredBytes = 0; // sum of the first measured size of every model read so far
+    size_t m_MeasuredModels = 0;
+    uint64_t m_Update = 0;
+    bool m_Changed = false;
+    StreamingStats m_Stats;
+
+    static uint64_t gridKey(int x, int z) {
+        return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+    }
+
+    // distance from the eye to the cell's square on the ground plane
+    float distance(const Cell& cell, const glm::vec3& eye) const {
+        float x0 = cell.x * m_CellSize, z0 = cell.z * m_CellSize;
+        float dx = std::max(std::max(x0 - eye.x, eye.x - (x0 + m_CellSize)), 0.0f);
+        float dz = std::max(std::max(z0 - eye.z, eye.z - (z0 + m_CellSize)), 0.0f);
+        return std::sqrt(dx * dx + dz * dz);
+    }
+
+    void partition() {
+        const std::vector<SceneInstance>& instances = m_Description.instances;
+        m_CellOf.assign(instances.size(), 0);
+        m_LocalIndex.assign(instances.size(), 0);
+        for (uint32_t i = 0; i < instances.size(); ++i) {
+            // the file rejects parents out of range, the step limit guards against cycles
+            uint32_t root = i;
+            for (size_t steps = 0; instances[root].parent != kNoParent && steps < instances.size(); ++steps)
+                root = instances[root].parent;
+            int x = (int)std::floor(instances[root].position.x / m_CellSize);
+            int z = (int)std::floor(instances[root].position.z / m_CellSize);
+            auto found = m_Grid.find(gridKey(x, z));
+            uint32_t cell;
+            if (found == m_Grid.end()) {
+                cell = (uint32_t)m_Cells.size();
+                m_Grid.emplace(gridKey(x, z), cell);
+                m_Cells.emplace_back();
+                m_Cells.back().x = x;
+                m_Cells.back().z = z;
+            } else {
+                cell = found->second;
+            }
+            m_CellOf[i] = cell;
+            m_LocalIndex[i] = (uint32_t)m_Cells[cell].instances.size();
+            m_Cells[cell].instances.push_back(i);
+            std::vector<uint32_t>& models = m_Cells[cell].models;
+            if (std::find(models.begin(), models.end(), instances[i].model) == models.end())
+                models.push_back(instances[i].model);
+        }
+        m_Stats.cells = m_Cells.size();
+    }
+
+    void release(uint32_t model) {
+        ModelSlot& slot = m_Slots[model];
+        if (--slot.users == 0)
+            slot.lastUsed = m_Update;
+    }
+
+    void unloadCell(Cell& cell) {
+        if (cell.state == CellState::Resident) {
+            m_Scene.destroy(cell.entities);
+            m_Stats.destroyedEntities += cell.entities.size();
+            cell.entities.clear();
+            m_Changed = true;
+        }
+        for (uint32_t model : cell.models)
+            release(model);
+        cell.state = CellState::Unloaded;
+    }
+
+    // what a model not in memory will take: its size when it was last read, else the average of the models read
+    size_t estimate(const ModelSlot& slot) const {
+        if (slot.measured)
+            return slot.measured;
+        return m_MeasuredModels ? m_MeasuredBytes / m_MeasuredModels : 0;
+    }
+
+    // bytes the cell's models not in memory or on their way will add
+    size_t missingBytes(const Cell& cell) const {
+        size_t bytes = 0;
+        for (uint32_t model : cell.models) {
+            if (m_Slots[model].state == ModelState::Unloaded)
+                bytes += estimate(m_Slots[model]);
+        }
+        return bytes;
+    }
+
+    void startCell(Cell& cell, uint32_t index) {
+        for (uint32_t model : cell.models) {
+            ModelSlot& slot = m_Slots[model];
+            ++slot.users;
+            if (slot.state == ModelState::Unloaded && model < m_Description.models.size()) {
+                std::string path = m_Description.models[model].path;
+                slot.decoding = ThreadPool::shared().submit([path] { return Model::Decode(path); });
+                slot.state = ModelState::Decoding;
+                slot.estimate = estimate(slot);
+                m_PendingBytes += slot.estimate;
+            }
+        }
+        cell.state = CellState::Loading;
+        m_Active.push_back(index);
+    }
+
+    // takes over finished decodes; blocking waits for all of them
+    void collectDecodes(bool blocking) {
+        for (uint32_t model = 0; model < m_Slots.size(); ++model) {
+            ModelSlot& slot = m_Slots[model];
+            if (slot.state != ModelState::Decoding)
+                continue;
+            if (!blocking && slot.decoding.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                continue;
+            slot.decoded = slot.decoding.get();
+            m_PendingBytes -= slot.estimate;
+            slot.estimate = 0;
+            if (slot.users == 0) {
+                // its cells left the range while it was being read
+                slot.decoded = Model();
+                slot.state = ModelState::Unloaded;
+                continue;
+            }
+            slot.bytes = slot.decoded.MemoryBytes();
+            m_ResidentBytes += slot.bytes;
+            slot.state = ModelState::Decoded;
+            m_Uploads.push_back(model);
+        }
+    }
+
+    void uploadModels(const StreamingSettings& settings, bool blocking) {
+        bool uploaded = false;
+        while (!m_Uploads.empty() && (blocking || !uploaded || m_Stats.uploadedBytes < settings.uploadBytesPerFrame)) {
+            uint32_t model = m_Uploads.front();
+            m_Uploads.pop_front();
+            ModelSlot& slot = m_Slots[model];
+            m_ResidentBytes -= slot.bytes;
+            if (slot.users == 0) {
+                slot.decoded = Model();
+                slot.state = ModelState::Unloaded;
+                continue;
+            }
+            slot.decoded.Upload();
+            m_Models[model] = std::move(slot.decoded);
+            slot.decoded = Model();
+            slot.bytes = m_Models[model].MemoryBytes();
+            m_ResidentBytes += slot.bytes;
+            if (!slot.measured) {
+                m_MeasuredBytes += slot.bytes;
+                ++m_MeasuredModels;
+            }
+            slot.measured = std::max<size_t>(slot.bytes, 1);
+            slot.state = ModelState::Resident;
+            m_ModelBounds[model] = Aabb();
+            for (const Mesh& mesh : m_Models[model].meshes)
+                m_ModelBounds[model].add(mesh.bounds);
+            m_Stats.uploadedBytes += slot.bytes;
+            uploaded = true;
+        }
+        if (uploaded)
+            GLState::invalidate();
+    }
+
+    // deletes unused models, least recently used first, until the resident and pending bytes fit below limit
+    void evict(size_t limit) {
+        bool released = false;
+        while (m_ResidentBytes + m_PendingBytes > limit) {
+            uint32_t victim = (uint32_t)m_Slots.size();
+            for (uint32_t model = 0; model < m_Slots.size(); ++model) {
+                const ModelSlot& slot = m_Slots[model];
+                if (slot.state == ModelState::Resident && slot.users == 0 &&
+                    (victim == m_Slots.size() || slot.lastUsed < m_Slots[victim].lastUsed))
+                    victim = model;
+            }
+            if (victim == m_Slots.size())
+                break;
+            ModelSlot& slot = m_Slots[victim];
+            m_Models[victim].Release();
+            m_ResidentBytes -= slot.bytes;
+            slot.bytes = 0;
+            slot.state = ModelState::Unloaded;
+            released = true;
+        }
+        if (released) {
+            GLState::invalidate();
+            m_Changed = true;
+        }
+    }
+
+    bool modelsResident(const Cell& cell) const {
+        for (uint32_t model : cell.models) {
+            if (m_Slots[model].state != ModelState::Resident)
+                return false;
+        }
+        return true;
+    }
+
+    void instantiateCell(Cell& cell) {
+        const std::vector<SceneInstance>& instances = m_Description.instances;
+        cell.entities.resize(cell.instances.size());
+        for (size_t i = 0; i < cell.instances.size(); ++i) {
+            const SceneInstance& instance = instances[cell.instances[i]];
+            Entity entity = m_Scene.create();
+            cell.entities[i] = entity;
+            m_Scene.transforms.add(entity, instance.position, glm::quat(glm::radians(instance.rotation)), instance.scale);
+            m_Scene.renderables.add(entity, instance.model, (uint8_t)instance.flags);
+            m_Scene.bounds.add(entity, m_ModelBounds[instance.model]);
+        }
+        for (size_t i = 0; i < cell.instances.size(); ++i) {
+            uint32_t parent = instances[cell.instances[i]].parent;
+            if (parent != kNoParent)
+                m_Scene.transforms.setParent(cell.entities[i], cell.entities[m_LocalIndex[parent]]);
+        }
+        cell.state = CellState::Resident;
+        m_Stats.createdEntities += cell.entities.size();
+        m_Changed = true;
+    }
+
+    // one round of streaming, returns true while cells in range are still loading or were just started
+    bool step(const glm::vec3& eye, const StreamingSettings& settings, bool blocking) {
+        // leave the cells that fell behind
+        float keep = settings.loadRadius + std::max(settings.unloadMargin, 0.0f);
+        size_t kept = 0;
+        for (uint32_t index : m_Active) {
+            if (distance(m_Cells[index], eye) > keep)
+                unloadCell(m_Cells[index]);
+            else
+                m_Active[kept++] = index;
+        }
+        m_Active.resize(kept);
+
+        // cells in range that are not loaded yet, nearest first. The grid around the eye is looked up cell by cell,
+        // unless it has more cells than the world
+        std::vector<std::pair<float, uint32_t>> wanted;
+        auto consider = [&](uint32_t index) {
+            float d = distance(m_Cells[index], eye);
+            if (m_Cells[index].state == CellState::Unloaded && d <= settings.loadRadius)
+                wanted.push_back({d, index});
+        };
+        double x0 = std::floor((eye.x - settings.loadRadius) / m_CellSize);
+        double x1 = std::floor((eye.x + settings.loadRadius) / m_CellSize);
+        double z0 = std::floor((eye.z - settings.loadRadius) / m_CellSize);
+        double z1 = std::floor((eye.z + settings.loadRadius) / m_CellSize);
+        if ((x1 - x0 + 1) * (z1 - z0 + 1) > (double)m_Cells.size()) {
+            for (uint32_t index = 0; index < m_Cells.size(); ++index)
+                consider(index);
+        } else {
+            for (int x = (int)x0; x <= (int)x1; ++x) {
+                for (int z = (int)z0; z <= (int)z1; ++z) {
+                    auto found = m_Grid.find(gridKey(x, z));
+                    if (found != m_Grid.end())
+                        consider(found->second);
+                }
+            }
+        }
+        std::sort(wanted.begin(), wanted.end());
+
+        collectDecodes(blocking);
+
+        // start as many as the budget allows, keeping the pool busy but not flooded
+        size_t decoding = 0;
+        for (const ModelSlot& slot : m_Slots)
+            decoding += slot.state == ModelState::Decoding;
+        bool started = false;
+        for (const std::pair<float, uint32_t>& cell : wanted) {
+            // nothing to estimate sizes from before the first model is read
+            if ((!blocking && decoding >= ThreadPool::shared().size()) || (m_MeasuredModels == 0 && decoding > 0))
+                break;
+            // the nearest cell is always taken, even if it alone is over the budget
+            size_t needed = missingBytes(m_Cells[cell.second]);
+            if (!m_Active.empty() && m_ResidentBytes + m_PendingBytes + needed > settings.memoryBudget) {
+                evict(settings.memoryBudget - std::min(needed, settings.memoryBudget));
+                if (m_ResidentBytes + m_PendingBytes + needed > settings.memoryBudget)
+                    break;
+            }
+            startCell(m_Cells[cell.second], cell.second);
+            started = true;
+            for (uint32_t model : m_Cells[cell.second].models)
+                decoding += m_Slots[model].state == ModelState::Decoding;
+        }
+
+        uploadModels(settings, blocking);
+
+        // cells whose models are all resident, nearest first, whole cells within the entity limit
+        std::vector<std::pair<float, uint32_t>> ready;
+        for (uint32_t index : m_Active) {
+            const Cell& cell = m_Cells[index];
+            if (cell.state == CellState::Loading && modelsResident(cell))
+                ready.push_back({distance(cell, eye), index});
+        }
+        std::sort(ready.begin(), ready.end());
+        size_t created = 0;
+        for (const std::pair<float, uint32_t>& cell : ready) {
+            if (!blocking && created > 0 && created + m_Cells[cell.second].instances.size() > settings.instancesPerFrame)
+                break;
+            instantiateCell(m_Cells[cell.second]);
+            created += m_Cells[cell.second].instances.size();
+        }
+
+        evict(settings.memoryBudget);
+
+        for (uint32_t index : m_Active) {
+            if (m_Cells[index].state == CellState::Loading)
+                return true;
+        }
+        return started;
+    }
+
+public:
+    WorldStreamer(const SceneDescription& description, std::vector<Model>& models, Scene& scene,
+                  const StreamingSettings& settings)
+        : m_Description(description), m_Models(models), m_Scene(scene),
+          m_CellSize(std::max(settings.cellSize, 1e-3f)) {
+        m_Models.resize(description.models.size());
+        m_Slots.resize(description.models.size());
+        m_ModelBounds.resize(description.models.size());
+        partition();
+    }
+
+    WorldStreamer(const WorldStreamer&) = delete;
+    WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+    // finishes the decodes still running, the models they return are dropped
+    ~WorldStreamer() {
+        for (ModelSlot& slot : m_Slots) {
+            if (slot.state == ModelState::Decoding)
+                slot.decoding.wait();
+        }
+    }
+
+    // once per frame on the GL thread, before the transform update
+    void update(const glm::vec3& eye, const StreamingSettings& settings) {
+        begin();
+        step(eye, settings, false);
+        finish();
+    }
+
+    // loads everything in range before returning, ignoring the per frame limits; for the first frame
+    void load(const glm::vec3& eye, const StreamingSettings& settings) {
+        begin();
+        while (step(eye, settings, true)) {
+        }
+        finish();
+    }
+
+    // entities were created or destroyed, or models released, by the last update
+    bool changed() const { return m_Changed; }
+
+    bool resident(uint32_t model) const {
+        return model < m_Slots.size() && m_Slots[model].state == ModelState::Resident;
+    }
+
+    const Aabb& modelBounds(uint32_t model) const { return m_ModelBounds[model]; }
+
+    const StreamingStats& stats() const { return m_Stats; }
+
+private:
+    void begin() {
+        ++m_Update;
+        m_Changed = false;
+        m_Stats.uploadedBytes = 0;
+        m_Stats.createdEntities = 0;
+        m_Stats.destroyedEntities = 0;
+    }
+
+    void finish() {
+        m_Stats.residentCells = m_Stats.loadingCells = 0;
+        for (uint32_t index : m_Active) {
+            if (m_Cells[index].state == CellState::Resident)
+                ++m_Stats.residentCells;
+            else
+                ++m_Stats.loadingCells;
+        }
+        m_Stats.residentModels = m_Stats.decodingModels = 0;
+        for (const ModelSlot& slot : m_Slots) {
+            m_Stats.residentModels += slot.state == ModelState::Resident;
+            m_Stats.decodingModels += slot.state == ModelState::Decoding;
+        }
+        m_Stats.residentBytes = m_ResidentBytes;
+        m_Stats.pendingBytes = m_PendingBytes;
+    }
+};
+
+}
+#endif //PROJECT_BASE_WORLDSTREAMING_H
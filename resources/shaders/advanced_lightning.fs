@@ -3,37 +3,39 @@
 layout (location = 0) out vec4 FragColor;
 layout (location = 1) out vec4 BrightColor;
 
+// member order follows the std140 packing of rg::GpuPointLight / rg::GpuSpotLight (include/rg/UniformBuffer.h)
 struct PointLight {
     vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
     float constant;
+    vec3 ambient;
     float linear;
+    vec3 diffuse;
     float quadratic;
+    vec3 specular;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
     float constant;
+    vec3 direction;
     float linear;
-    float quadratic;
-
     vec3 ambient;
+    float quadratic;
     vec3 diffuse;
+    float cutOff;
     vec3 specular;
+    float outerCutOff;
 };
 
 
 struct Material {
     sampler2D texture_diffuse1;
+#ifdef HAS_SPECULAR_MAP
     sampler2D texture_specular1;
+#endif
+#ifdef HAS_NORMAL_MAP
+    sampler2D texture_normal1;
+#endif
 
     float shininess;
 };
@@ -41,19 +43,40 @@ struct Material {
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
+#ifdef HAS_NORMAL_MAP
+in vec4 Tangent;
+#endif
 
+// size of the light arrays in the Lights block; variants compiled by rg::ShaderPermutations define how many of
+// them are lit, plus SHADOWS, PCF_SAMPLES, HAS_SPECULAR_MAP and HAS_NORMAL_MAP
 #define NUM_LIGHTS 3
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS NUM_LIGHTS
+#endif
+#ifndef NUM_SPOT_LIGHTS
+#define NUM_SPOT_LIGHTS NUM_LIGHTS
+#endif
+#ifndef PCF_SAMPLES
+#define PCF_SAMPLES 10
+#endif
+
+layout (std140) uniform Lights {
+    PointLight pointLight[NUM_LIGHTS];
+    SpotLight spotLight[NUM_LIGHTS];
+};
 
-uniform SpotLight spotLight[NUM_LIGHTS];
-uniform PointLight pointLight[NUM_LIGHTS];
-uniform Material material;
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
 
-uniform vec3 cameraPos;
-uniform vec3 viewPosition;
+uniform Material material;
 
-uniform bool shadow_flag;
+#ifdef SHADOWS
 uniform float far_plane;
 uniform samplerCube depthMap;
+#endif
 
 // calculates the color when using a point light.
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
@@ -62,29 +85,30 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, f
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(viewDir, halfwayDir), 0.0), material.shininess);
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
     // combine results
     vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
     ambient *= attenuation;
     diffuse *= attenuation;
+#ifdef HAS_SPECULAR_MAP
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(viewDir, halfwayDir), 0.0), material.shininess);
+    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
     specular *= attenuation;
     return (ambient + shadow * diffuse + shadow * specular);
+#else
+    return (ambient + shadow * diffuse);
+#endif
 }
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
  {
      vec3 lightDir = normalize(light.position - fragPos);
      // diffuse shading
      float diff = max(dot(normal, lightDir), 0.0);
-     // specular shading
-     vec3 halfwayDir = normalize(lightDir + viewDir);
-     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
      // attenuation
      float distance = length(light.position - fragPos);
      float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
@@ -95,19 +119,27 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, flo
      // combine results
      vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
      vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-     vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
      ambient *= attenuation * intensity;
      diffuse *= attenuation * intensity;
+#ifdef HAS_SPECULAR_MAP
+     // specular shading
+     vec3 halfwayDir = normalize(lightDir + viewDir);
+     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+     vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
      specular *= attenuation * intensity;
      return (ambient + shadow * diffuse + shadow * specular);
+#else
+     return (ambient + shadow * diffuse);
+#endif
  }
 
- float CalcShadow(vec3 fragPos, int depthMapId, vec3 lightPosition) {
+#ifdef SHADOWS
+ float CalcShadow(vec3 fragPos, vec3 lightPosition) {
 
     vec3 fragToLight = fragPos - lightPosition;
     float shadow = 0.0;
     float bias = 0.01;
-    float samples = 10.0;
+    float samples = float(PCF_SAMPLES);
     float offset = 0.15;
     for(float x = -offset; x < offset; x += offset / (samples * 0.5)) {
      for(float y = -offset; y < offset; y += offset / (samples * 0.5)) {
@@ -125,30 +157,34 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, flo
 
     return shadow;
  }
+#endif
 
 void main()
 {
     vec3 normal = normalize(Normal);
+#ifdef HAS_NORMAL_MAP
+    // tangent frame from the generated tangents, bitangent = cross(normal, tangent) * handedness
+    vec3 tangent = normalize(Tangent.xyz - normal * dot(normal, Tangent.xyz));
+    vec3 bitangent = cross(normal, tangent) * Tangent.w;
+    vec3 mappedNormal = texture(material.texture_normal1, TexCoords).rgb * 2.0 - 1.0;
+    normal = normalize(mat3(tangent, bitangent, normal) * mappedNormal);
+#endif
     vec3 viewDir = normalize(viewPosition - FragPos);
     vec3 result = vec3(0,0,0);
 
-    for(int i = 0; i < NUM_LIGHTS; i++){
+    for(int i = 0; i < NUM_POINT_LIGHTS; i++){
         float pointLightShadow = 1.0;
-        float spotLightShadow = 1.0;
-
-        if (shadow_flag) {
-            pointLightShadow = CalcShadow(FragPos, i, pointLight[i].position);
-            spotLightShadow = CalcShadow(FragPos, i, spotLight[i].position);
-        }
-        vec3 pointLightColor = CalcPointLight(pointLight[i], normal, FragPos, viewDir, pointLightShadow);
-        vec3 spotLightColor = CalcSpotLight(spotLight[i],normal,FragPos,viewDir, 1.0);
-
-        result += pointLightColor;
-        result += spotLightColor;
+#ifdef SHADOWS
+        pointLightShadow = CalcShadow(FragPos, pointLight[i].position);
+#endif
+        result += CalcPointLight(pointLight[i], normal, FragPos, viewDir, pointLightShadow);
+    }
+    for(int i = 0; i < NUM_SPOT_LIGHTS; i++){
+        result += CalcSpotLight(spotLight[i], normal, FragPos, viewDir, 1.0);
     }
 
     // Camera distance blending
-    float cameraDistance = min(1.0, length(FragPos-cameraPos) / 1.5);
+    float cameraDistance = min(1.0, length(FragPos-viewPosition) / 1.5);
 
     FragColor = vec4(result, cameraDistance);
 }
\ No newline at end of file
@@ -2,19 +2,42 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef HAS_NORMAL_MAP
+layout (location = 3) in vec4 aTangent;
+out vec4 Tangent;
+#endif
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
+#ifdef INSTANCED
+// per instance transform, see Model::DrawInstanced
+layout (location = 4) in mat4 instanceModel;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix; // inverse transpose of model's upper 3x3, cached with the scene's transforms
+#endif
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = instanceModel;
+    // instances are only rotated and uniformly scaled (the rest is drawn per mesh, see rg::uniformlyScaled), which
+    // keeps normals perpendicular; the fragment shader normalizes them
+    mat3 normalMatrix = mat3(instanceModel);
+#endif
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = aNormal;
-    TexCoords = aTexCoords;    
+    Normal = normalMatrix * aNormal;
+    TexCoords = aTexCoords;
+#ifdef HAS_NORMAL_MAP
+    Tangent = vec4(mat3(model) * aTangent.xyz, aTangent.w); // world space, like Normal
+#endif
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
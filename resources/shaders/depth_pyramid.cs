@@ -0,0 +1,24 @@
+#version 430 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// one level of the depth pyramid: every texel keeps the farthest depth of the source texels it covers, partly
+// covered ones included, so any ratio between the sizes stays conservative
+uniform sampler2D source; // the depth buffer copy or the level above
+uniform int sourceLevel;
+layout (r32f, binding = 0) writeonly uniform image2D target;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 targetSize = imageSize(target);
+    if (any(greaterThanEqual(texel, targetSize)))
+        return;
+    ivec2 sourceSize = textureSize(source, sourceLevel);
+    ivec2 first = texel * sourceSize / targetSize;
+    ivec2 last = max(first, ((texel + 1) * sourceSize + targetSize - 1) / targetSize - 1);
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; ++y)
+        for (int x = first.x; x <= last.x; ++x)
+            farthest = max(farthest, texelFetch(source, ivec2(x, y), sourceLevel).r);
+    imageStore(target, texel, vec4(farthest));
+}
\ No newline at end of file
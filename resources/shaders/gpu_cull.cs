@@ -0,0 +1,83 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// see rg::DrawElementsIndirectCommand
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Instances { mat4 transforms[]; };
+layout (std430, binding = 1) readonly buffer Bounds { vec4 bounds[]; }; // world box of instance i: min at 2i, max at 2i + 1
+layout (std430, binding = 2) writeonly buffer Visible { mat4 visible[]; }; // the model's instance attribute buffer
+layout (std430, binding = 3) buffer Counter { uint visibleCount; };
+layout (std430, binding = 4) buffer Commands { DrawCommand commands[]; };
+
+#ifdef WRITE_COMMANDS
+// second pass: every mesh draws all the survivors
+uniform int commandCount;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i < uint(commandCount))
+        commands[i].instanceCount = visibleCount;
+}
+#else
+uniform int instanceCount;
+uniform vec4 frustumPlanes[6];
+// depth pyramid of the last frame and the view projection it was drawn with
+uniform bool occlusion;
+uniform sampler2D depthPyramid;
+uniform mat4 pyramidViewProjection;
+
+bool outsideFrustum(vec3 center, vec3 extent)
+{
+    for (int p = 0; p < 6; ++p) {
+        vec4 plane = frustumPlanes[p];
+        if (dot(plane.xyz, center) + dot(abs(plane.xyz), extent) + plane.w < 0.0)
+            return true;
+    }
+    return false;
+}
+
+// hidden if the nearest point of the box is behind the farthest depth of the pyramid texels covering it, read at
+// the level where that is at most 2x2 texels
+bool occluded(vec3 boxMin, vec3 boxMax)
+{
+    vec3 ndcMin = vec3(1.0e30), ndcMax = vec3(-1.0e30);
+    for (int corner = 0; corner < 8; ++corner) {
+        vec3 point = vec3((corner & 1) != 0 ? boxMax.x : boxMin.x, (corner & 2) != 0 ? boxMax.y : boxMin.y,
+                          (corner & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = pyramidViewProjection * vec4(point, 1.0);
+        if (clip.z < -clip.w)
+            return false; // reaches through the near plane
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+    vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0), uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 size = (uvMax - uvMin) * vec2(textureSize(depthPyramid, 0));
+    int level = min(int(ceil(log2(max(max(size.x, size.y), 1.0)))), textureQueryLevels(depthPyramid) - 1);
+    ivec2 levelSize = textureSize(depthPyramid, level);
+    ivec2 first = min(ivec2(uvMin * vec2(levelSize)), levelSize - 1);
+    ivec2 last = min(ivec2(uvMax * vec2(levelSize)), levelSize - 1);
+    float farthest = max(max(texelFetch(depthPyramid, first, level).r, texelFetch(depthPyramid, ivec2(last.x, first.y), level).r),
+                         max(texelFetch(depthPyramid, ivec2(first.x, last.y), level).r, texelFetch(depthPyramid, last, level).r));
+    return ndcMin.z * 0.5 + 0.5 > farthest;
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= uint(instanceCount))
+        return;
+    vec3 boxMin = bounds[2 * i].xyz, boxMax = bounds[2 * i + 1].xyz;
+    if (outsideFrustum((boxMin + boxMax) * 0.5, (boxMax - boxMin) * 0.5) || (occlusion && occluded(boxMin, boxMax)))
+        return;
+    visible[atomicAdd(visibleCount, 1u)] = transforms[i];
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+// only the query counts the samples, color and depth writes are off
+void main()
+{
+    FragColor = vec4(1.0);
+}
\ No newline at end of file
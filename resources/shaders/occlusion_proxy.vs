@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos; // corner of the unit cube
+
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+void main()
+{
+    gl_Position = projection * view * vec4(mix(boxMin, boxMax, aPos), 1.0);
+}
\ No newline at end of file
@@ -1,9 +1,17 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+#ifdef INSTANCED
+// per instance transform, see Model::DrawInstanced
+layout (location = 4) in mat4 instanceModel;
+#else
 uniform mat4 model;
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = instanceModel;
+#endif
     gl_Position = model * vec4(aPos, 1.0);
 }
\ No newline at end of file
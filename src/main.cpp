@@ -13,8 +13,23 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <rg/Bvh.h>
+#include <rg/Cubemap.h>
+#include <rg/GLExtensions.h>
+#include <rg/FrustumCulling.h>
+#include <rg/GLState.h>
+#include <rg/GpuCulling.h>
+#include <rg/OcclusionQueries.h>
+#include <rg/RenderQueue.h>
+#include <rg/Scene.h>
+#include <rg/SceneFile.h>
+#include <rg/ShaderPermutations.h>
+#include <rg/SoftwareOcclusion.h>
+#include <rg/UniformBuffer.h>
+#include <rg/WorldStreaming.h>
 
 #include <iostream>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -26,7 +41,7 @@ void processInput(GLFWwindow *window);
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 
-unsigned int loadCubemap(vector<std::string> faces);
+unsigned int loadCubemap(const std::string &precompressed, vector<std::future<rg::CubemapFace>> &faces);
 
 bool SHADOW_FLAG = true;
 
@@ -44,6 +59,134 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// meshes kept and dropped by culling in the last frame
+struct CullStats {
+    size_t visible = 0;
+    size_t culled = 0;
+    size_t shadowCasters = 0;
+    size_t shadowCulled = 0;
+    size_t occluded = 0;
+    size_t softwareOccluded = 0;
+    size_t occluderTriangles = 0;
+    double occluderMilliseconds = 0.0;
+    size_t fieldInstances = 0;
+    size_t fieldDrawn = 0; // CPU path only, the GPU path never reads its count back
+    size_t sceneInstances = 0; // instanced renderables of the scene, drawn like the field
+    size_t sceneInstancesDrawn = 0;
+    size_t sceneInstanceShadows = 0; // copies drawn into the shadow map
+    bool gpuCulling = false;
+    // clusters of the meshes split into meshlets, in the meshes that got past the mesh level tests
+    size_t meshletsDrawn = 0;
+    size_t meshletsCulled = 0;
+    size_t shadowMeshletsDrawn = 0;
+    size_t shadowMeshletsCulled = 0;
+    size_t litMeshes[rg::kNumLights] = {};
+};
+CullStats cullStats;
+// what the world streaming did in the last frame
+rg::StreamingStats streamingStats;
+
+// culling state kept across frames, the vectors are per frame scratch
+struct SceneCulling {
+    rg::Bvh bvh;
+    rg::FrustumCuller culler;
+    vector<std::pair<Mesh*, const glm::mat4*>> meshes;
+    vector<const glm::mat3*> normalMatrices; // by mesh, like meshes
+    vector<rg::Aabb> bounds;
+    vector<uint8_t> visible;
+    vector<uint32_t> candidates;
+    // per renderable row: which one a mesh belongs to, its world box and whether any of its meshes is in view, what
+    // the occlusion queries test
+    vector<uint32_t> owners;
+    vector<rg::Aabb> modelBounds;
+    vector<uint8_t> modelInView;
+    vector<rg::IndexRange> ranges; // meshlets kept of one mesh
+};
+
+// Copies of one model drawn together: culled and drawn without the CPU where compute shaders are available, frustum
+// culled on the CPU and drawn instanced otherwise. The transforms follow the set's entities, sets without any (the
+// flower field) keep the ones they were given.
+struct InstanceSet {
+    Model *model = nullptr;
+    vector<rg::Entity> entities;
+    vector<glm::mat4> transforms;
+    vector<uint8_t> castsShadow; // by transform, like entities
+    std::unique_ptr<rg::GpuCulling> gpu;
+    rg::FrustumCuller culler;
+    vector<glm::mat4> visible;
+
+    // hands the transforms to the culling, again whenever they change
+    void upload() {
+        if (rg::GpuCulling::supported()) {
+            if (!gpu)
+                gpu.reset(new rg::GpuCulling(*model));
+            gpu->setInstances(transforms.data(), (GLsizei)transforms.size());
+            return;
+        }
+        rg::Aabb bounds;
+        for (const Mesh &mesh : model->meshes)
+            bounds.add(mesh.bounds);
+        culler.clear();
+        for (const glm::mat4 &transform : transforms)
+            culler.add(rg::transformAabb(bounds, transform));
+    }
+
+    // takes over the entities moved by the last transform update; false if one of them is no longer uniformly
+    // scaled, the set has to be regrouped without it
+    bool refresh(const rg::Scene &scene) {
+        bool moved = false;
+        for (size_t i = 0; i < entities.size(); i++) {
+            uint32_t row = scene.transforms.rows.row(entities[i]);
+            if (row != rg::kNoRow && scene.transforms.changed[row]) {
+                transforms[i] = scene.transforms.world[row];
+                if (!rg::uniformlyScaled(transforms[i]))
+                    return false;
+                moved = true;
+            }
+        }
+        if (moved)
+            upload();
+        return true;
+    }
+
+    // copies drawn; all of them on the GPU path, which never reads its count back
+    size_t draw(rg::ShaderPermutations &variants, uint32_t frameFeatures, const rg::Frustum &frustum,
+                const rg::DepthPyramid &pyramid) {
+        if (gpu) {
+            gpu->cull(frustum, &pyramid);
+            gpu->draw(variants, frameFeatures);
+            return transforms.size();
+        }
+        culler.cull(frustum);
+        visible.clear();
+        for (size_t i = 0; i < transforms.size(); i++) {
+            if (culler.visible(i))
+                visible.push_back(transforms[i]);
+        }
+        model->DrawInstanced(variants, frameFeatures, visible.data(), (GLsizei)visible.size());
+        return visible.size();
+    }
+
+    // the shadow casting copies whose bounding sphere reaches into the light's range, with the instanced depth
+    // program bound by the caller. Goes through the model's instance buffer as well, before the main pass fills it.
+    size_t drawShadow(Shader &shader, const glm::vec3 &lightPosition, float range) {
+        rg::Aabb bounds;
+        for (const Mesh &mesh : model->meshes)
+            bounds.add(mesh.bounds);
+        rg::Sphere sphere = rg::boundingSphere(bounds);
+        visible.clear();
+        for (size_t i = 0; i < transforms.size(); i++) {
+            if (!castsShadow[i])
+                continue;
+            rg::Sphere world = rg::transformSphere(sphere, transforms[i]);
+            if (glm::length(world.center - lightPosition) <= range + world.radius)
+                visible.push_back(transforms[i]);
+        }
+        model->DrawInstanced(shader, visible.data(), (GLsizei)visible.size());
+        return visible.size();
+    }
+};
+
 struct PointLight {
     glm::vec3 position;
     glm::vec3 ambient;
@@ -60,29 +203,6 @@ struct ProgramState {
     bool ImGuiEnabled = false;
     Camera camera;
     bool CameraMouseMovementUpdateEnabled = true;
-    glm::vec3 backpackPosition = glm::vec3(0.0f);
-    glm::vec3 grassPosition = glm::vec3(0.0f);
-    glm::vec3 carPosition = glm::vec3(-3.0f, 1.2f, 2.0f);
-    glm::vec3 lampPosition = glm::vec3(-20.0f, 1.0f, 13.0f);
-    glm::vec3 lamp2Position = glm::vec3(4.0f, 0.0f, 0.0f);
-    glm::vec3 catPosition = glm::vec3(-160.0f, 50.0f, -223.0f);
-    glm::vec3 roadPosition = glm::vec3(0.0f, 0.0f, 0.0f);
-    glm::vec3 tablePosition = glm::vec3(5.0f, 1.0f, 4.5f);
-    glm::vec3 flowerPosition = glm::vec3(5.0f, 1.1f, 5.5f);
-    glm::vec3 treePosition = glm::vec3(4.5f, 0.0f, -4.5f);
-    glm::vec3 doorPosition = glm::vec3(3.5f, 0.0f, -4.5f);
-
-    float grassScale = 0.05f;
-    float carScale = 0.8f;
-    float lampScale = 0.2f;
-    float lamp2Scale = 1.2f;
-    float catScale = 0.015f;
-    float roadScale = 5.0f;
-    float tableScale = 0.006f;
-    float flowerScale = 2.0f;
-    float treeScale = 0.008f;
-    float doorScale = 0.05f;
-
     PointLight pointLight;
     ProgramState()
             : camera(glm::vec3(0.0f, 0.0f, 3.0f)) {}
@@ -91,12 +211,6 @@ struct ProgramState {
 
     void LoadFromFile(std::string filename);
 
-    glm::vec3 pointLightPositions[3] = {
-            glm::vec3(4.8f, 4.0f, 0.9f),
-            glm::vec3(-2.3f,1.0f,-0.3f),
-            glm::vec3(-3.3f,4.0f,3.2f)
-    };
-
     glm::vec3 diffuse_plight = glm::vec3(4.5f, 0.0f, -4.5f);
     glm::vec3 specular_plight = glm::vec3(0.0f,5.0f,5.0f);
     glm::vec3 ambient_plight = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -113,9 +227,33 @@ struct ProgramState {
     float quadratic_slight = 1.0f;
     float cutOff_slight = 1.0f;
     float outerCutOff_slight = 20.0f;
+
+    // lighting shader specialization, see rg::ShaderPermutations
+    int pcfQuality = (int)rg::PcfQuality::High;
+    int pointLightCount = rg::kNumLights;
+    int spotLightCount = rg::kNumLights;
+    bool flowerField = false;
+    // how much of the world is loaded around the camera
+    rg::StreamingSettings streaming;
 };
 
-void renderScene(Shader &shader, vector<Model> &models);
+// the binary form is used when there is one, scene_convert writes it
+const char *const kSceneFile = "resources/scenes/garden.scene";
+const char *const kBinarySceneFile = "resources/scenes/garden.sceneb";
+// scene model the flower field is made of
+const char *const kFlowerFieldModel = "flower";
+
+vector<glm::mat4> flowerFieldTransforms(float flowerScale);
+
+void submitScene(rg::RenderQueue &queue, SceneCulling &culling, vector<Model> &models, const rg::Scene &scene,
+                 Shader *shadowShader, const glm::vec3 &lightPosition, const glm::mat4 *shadowFaces, float shadowRange,
+                 rg::ShaderPermutations &variants, uint32_t frameFeatures, const rg::Frustum &frustum,
+                 const glm::vec3 &viewPosition, float viewRange, const rg::OcclusionQueries &occlusion,
+                 rg::SoftwareOcclusion &softwareOcclusion);
+
+void countLitMeshes(const SceneCulling &culling, const rg::LightUniforms &lights, int pointLights);
+
+rg::LightUniforms sceneLights(const rg::Scene &scene);
 
 void ProgramState::SaveToFile(std::string filename) {
     std::ofstream out(filename);
@@ -149,7 +287,7 @@ void ProgramState::LoadFromFile(std::string filename) {
 
 ProgramState *programState;
 
-void DrawImGui(ProgramState *programState);
+void DrawImGui(ProgramState *programState, rg::Scene &scene);
 
 int main() {
     // glfw: initialize and configure
@@ -185,10 +323,30 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    rg::loadGLExtensions((GLADloadproc) glfwGetProcAddress);
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
 
+    // read assets from the resource pack when one was built (see tools/resource_pack.cpp),
+    // its compressed entries are decompressed on worker threads while the shaders compile
+    if (rg::Resources::mount("resources.pack"))
+        rg::Resources::prefetchAll();
+
+    // the skybox faces decode on the worker threads while the shaders compile
+    vector<std::string> skyboxImages =
+            {
+                    "resources/objects/skybox/right.jpg",
+                    "resources/objects/skybox/left.jpg",
+                    "resources/objects/skybox/bottom.jpg",
+                    "resources/objects/skybox/top.jpg",
+                    "resources/objects/skybox/front.jpg",
+                    "resources/objects/skybox/back.jpg"
+            };
+    vector<std::future<rg::CubemapFace>> skyboxFaces;
+    if (!rg::Resources::exists("resources/objects/skybox/skybox.ktx"))
+        skyboxFaces = rg::decodeCubemapAsync(skyboxImages);
+
     programState = new ProgramState;
     programState->LoadFromFile("resources/program_state.txt");
     if (programState->ImGuiEnabled) {
@@ -217,11 +375,22 @@ int main() {
 
     // build and compile shaders
     // -------------------------
-    Shader ourShader("resources/shaders/advanced_lightning.vs", "resources/shaders/advanced_lightning.fs");
-    Shader skyboxShader("resources/shaders/skybox.vs","resources/shaders/skybox.fs");
-    Shader shadowShader("resources/shaders/shadows.vs", "resources/shaders/shadows.fs", "resources/shaders/shadows.geom");
-    Shader blurShader("resources/shaders/blur.vs", "resources/shaders/blur.fs");
-    Shader bloomShader("resources/shaders/bloom.vs", "resources/shaders/bloom.fs");
+    // everything is only submitted here; the driver compiles while the skybox and models load below
+    // and the programs are finished right before their uniforms are first set
+    // variants are compiled from #define sets as materials and frame settings ask for them
+    rg::ShaderPermutations lightingShaders("resources/shaders/advanced_lightning.vs", "resources/shaders/advanced_lightning.fs");
+    Shader skyboxShader("resources/shaders/skybox.vs","resources/shaders/skybox.fs", nullptr, "", ShaderBuild::Deferred);
+    Shader shadowShader("resources/shaders/shadows.vs", "resources/shaders/shadows.fs", "resources/shaders/shadows.geom", "", ShaderBuild::Deferred);
+    // the same for the instanced scene objects, transforms from attributes 4-7
+    Shader shadowInstancedShader("resources/shaders/shadows.vs", "resources/shaders/shadows.fs", "resources/shaders/shadows.geom",
+                                 "#define INSTANCED\n", ShaderBuild::Deferred);
+    Shader blurShader("resources/shaders/blur.vs", "resources/shaders/blur.fs", nullptr, "", ShaderBuild::Deferred);
+    Shader bloomShader("resources/shaders/bloom.vs", "resources/shaders/bloom.fs", nullptr, "", ShaderBuild::Deferred);
+    // the first frame needs every material combination with the saved frame settings
+    uint32_t startupFeatures = rg::frameFeatures(SHADOW_FLAG, (rg::PcfQuality)programState->pcfQuality,
+                                                 programState->pointLightCount, programState->spotLightCount);
+    for (int material = 0; material < 4; ++material)
+        lightingShaders.prepare(startupFeatures | rg::materialFeatures(material & 1, material & 2));
 
     float skyboxVertices[] = {
             // positions
@@ -276,39 +445,37 @@ int main() {
             1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
     };
 
-    vector<std::string> skyboxImages =
-            {
-                    "resources/objects/skybox/right.jpg",
-                    "resources/objects/skybox/left.jpg",
-                    "resources/objects/skybox/bottom.jpg",
-                    "resources/objects/skybox/top.jpg",
-                    "resources/objects/skybox/front.jpg",
-                    "resources/objects/skybox/back.jpg"
-            };
-    unsigned int cubemapTexture = loadCubemap(skyboxImages);
+    unsigned int cubemapTexture = loadCubemap("resources/objects/skybox/skybox.ktx", skyboxFaces);
+    if (!cubemapTexture) {
+        skyboxFaces = rg::decodeCubemapAsync(skyboxImages);
+        cubemapTexture = loadCubemap("", skyboxFaces);
+    }
 
-    // load models
-    // -----------
+    // load the scene; its models and instances stream in around the camera, what is in range before the first
+    // frame is loaded right here
+    // -----------------------------------------------------------------------------------------------------------
+    rg::SceneDescription sceneDescription;
+    std::string sceneError;
+    const char *scenePath = rg::Resources::exists(kBinarySceneFile) ? kBinarySceneFile : kSceneFile;
+    if (!rg::SceneFile::load(scenePath, sceneDescription, &sceneError))
+        std::cout << "ERROR::SCENE:: " << sceneError << std::endl;
+    rg::Scene scene;
+    rg::instantiateLights(sceneDescription, scene);
     vector<Model> models;
-    Model grassModel("resources/objects/grass/10450_Rectangular_Grass_Patch_v1_iterations-2.obj"); models.push_back(grassModel);
-    Model carModel("resources/objects/car/S15_bonnet.obj"); models.push_back(carModel);
-    Model lampModel("resources/objects/Street Lamp/StreetLamp.obj"); models.push_back(lampModel);
-    Model lamp2Model("resources/objects/lamp2/source/street-lamp-obj/farola1.obj"); models.push_back(lamp2Model);
-    Model catModel("resources/objects/cat/source/cat-obj/cat.obj"); models.push_back(catModel);
-    Model tableModel("resources/objects/table/source/table/table.obj"); models.push_back(tableModel);
-    Model flowerModel("resources/objects/flower/Scaniverse.obj"); models.push_back(flowerModel);
-    Model treeModel("resources/objects/coconutTree/coconutTreeBended.obj"); models.push_back(treeModel);
-    Model doorModel("resources/objects/glassdoor/Glass Door.obj"); models.push_back(doorModel);
-
-    grassModel.SetShaderTextureNamePrefix("material.");
-    carModel.SetShaderTextureNamePrefix("material.");
-    lampModel.SetShaderTextureNamePrefix("material.");
-    lamp2Model.SetShaderTextureNamePrefix("material.");
-    catModel.SetShaderTextureNamePrefix("material.");
-    tableModel.SetShaderTextureNamePrefix("material.");
-    flowerModel.SetShaderTextureNamePrefix("material.");
-    treeModel.SetShaderTextureNamePrefix("material.");
-    doorModel.SetShaderTextureNamePrefix("material.");
+    rg::WorldStreamer streamer(sceneDescription, models, scene, programState->streaming);
+    streamer.load(programState->camera.Position, programState->streaming);
+    rg::Resources::releaseCache();
+
+    // models placed as occluders somewhere in the scene; the largest triangles of those that are resident are the
+    // occluders of the CPU occlusion pass
+    vector<uint8_t> occluderModels(models.size(), 0);
+    for (const rg::SceneInstance &instance : sceneDescription.instances) {
+        if (instance.flags & rg::kOccluder)
+            occluderModels[instance.model] = 1;
+    }
+    vector<rg::OccluderMesh> occluders(models.size());
+    // models set up for drawing, see the start of the render loop
+    vector<uint8_t> modelsReady(models.size(), 0);
 
     PointLight& pointLight = programState->pointLight;
     pointLight.position = glm::vec3(-4.0f,2.7f,-1.6f);
@@ -424,227 +591,310 @@ int main() {
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window)) {
-        glm::mat4 model = glm::mat4(1.0f);
-
-        // per-frame time logic
-        // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        // -----
-        processInput(window);
-
-
-        // render
-        // ------
-        glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // don't forget to enable shader before setting uniforms
-        ourShader.use();
-        ourShader.setVec3("cameraPos", programState->camera.Position);
-
-        // FIRST LIGHT SOURCE -------------------------------------------------------=
-        ourShader.setVec3("pointLight[0].position", programState->pointLightPositions[0]);
-        ourShader.setVec3("pointLight[0].ambient", glm::vec3(0.0f, 4.0f, 10.0f));
-        ourShader.setVec3("pointLight[0].diffuse", glm::vec3(0.5f, 0.0f, -2.5f));
-        ourShader.setVec3("pointLight[0].specular", glm::vec3(-1.0f, 5.0f, 16.0f));
-        ourShader.setFloat("pointLight[0].constant", 1.0f);
-        ourShader.setFloat("pointLight[0].linear", 1.0f);
-        ourShader.setFloat("pointLight[0].quadratic", 0.2f);
-        ourShader.setVec3("viewPosition", programState->camera.Position);
-        ourShader.setFloat("material.shininess", 32.0f);
-
-        ourShader.setVec3("spotLight[0].position", programState->pointLightPositions[0]);
-        ourShader.setVec3("spotLight[0].direction", glm::vec3(0.0f, -1.0f, 0.0f));
-        ourShader.setVec3("spotLight[0].ambient", glm::vec3(0.0f, -4.0f, -1.0f));
-        ourShader.setVec3("spotLight[0].diffuse", glm::vec3(-1.0f, 0.0f, 1.0f));
-        ourShader.setVec3("spotLight[0].specular", glm::vec3(2.0f, 0.0f, 0.0f));
-        ourShader.setFloat("spotLight[0].constant", 1.0f);
-        ourShader.setFloat("spotLight[0].linear", 1.0f);
-        ourShader.setFloat("spotLight[0].quadratic", 0.35f);
-        ourShader.setFloat("spotLight[0].cutOff", glm::cos(glm::radians(1.0f)));
-        ourShader.setFloat("spotLight[0].outerCutOff", glm::cos(glm::radians(50.0f)));
-
-        //SECOND LIGHT SOURCE -------------------------
-        ourShader.setVec3("pointLight[1].position", programState->pointLightPositions[1]);
-        ourShader.setVec3("pointLight[1].ambient", glm::vec3(2.0f, 2.0f, -2.0f));
-        ourShader.setVec3("pointLight[1].diffuse", glm::vec3(5.5f, 3.0f, -14.5f));
-        ourShader.setVec3("pointLight[1].specular", glm::vec3(21.0f, 0.0f, 0.0f));
-        ourShader.setFloat("pointLight[1].constant", 2.4f);
-        ourShader.setFloat("pointLight[1].linear", 0.75f);
-        ourShader.setFloat("pointLight[1].quadratic", 0.7f);
-        ourShader.setVec3("viewPosition", programState->camera.Position);
-        ourShader.setFloat("material.shininess", 32.0f);
-
-        ourShader.setVec3("spotLight[1].position", programState->pointLightPositions[1]);
-        ourShader.setVec3("spotLight[1].direction", glm::vec3(0.0f, 0.0f, 1.0f));
-        ourShader.setVec3("spotLight[1].ambient", glm::vec3(10.0f, -1.0f, 2.0f));
-        ourShader.setVec3("spotLight[1].diffuse", glm::vec3(34.0f, 4.0f, 12.0f));
-        ourShader.setVec3("spotLight[1].specular", glm::vec3(-6.0f, 15.0f, 9.0f));
-        ourShader.setFloat("spotLight[1].constant", 2.7f);
-        ourShader.setFloat("spotLight[1].linear", 0.0f);
-        ourShader.setFloat("spotLight[1].quadratic", 5.1f);
-        ourShader.setFloat("spotLight[1].cutOff", glm::cos(glm::radians(0.750f)));
-        ourShader.setFloat("spotLight[1].outerCutOff", glm::cos(glm::radians(90.0f)));
-
-        //THIRD LIGHT SOURCE------------------------------------------
-        ourShader.setVec3("pointLight[2].position", programState->pointLightPositions[2]);
-        ourShader.setVec3("pointLight[2].ambient", glm::vec3(22.0f, -48.0f, 0.0f));
-        ourShader.setVec3("pointLight[2].diffuse", glm::vec3(0.0f, 10.0f, -2.0f));
-        ourShader.setVec3("pointLight[2].specular", glm::vec3(41.0f, 4.0f, -22.0f));
-        ourShader.setFloat("pointLight[2].constant", 0.9f);
-        ourShader.setFloat("pointLight[2].linear", 1.6f);
-        ourShader.setFloat("pointLight[2].quadratic", 2.5f);
-        ourShader.setVec3("viewPosition", programState->camera.Position);
-        ourShader.setFloat("material.shininess", 32.0f);
-
-        ourShader.setVec3("spotLight[2].position", programState->pointLightPositions[2]);
-        ourShader.setVec3("spotLight[2].direction", glm::vec3(0.0f, -1.0f, 0.0f));
-        ourShader.setVec3("spotLight[2].ambient", glm::vec3(9.0f, 1.0f, 0.0f));
-        ourShader.setVec3("spotLight[2].diffuse", glm::vec3(25.0f, 36.0f, -5.0f));
-        ourShader.setVec3("spotLight[2].specular", glm::vec3(2.0f, 1.0f, -5.0f));
-        ourShader.setFloat("spotLight[2].constant", 0.5f);
-        ourShader.setFloat("spotLight[2].linear", 0.65f);
-        ourShader.setFloat("spotLight[2].quadratic", 0.2f);
-        ourShader.setFloat("spotLight[2].cutOff", glm::cos(glm::radians(1.0f)));
-        ourShader.setFloat("spotLight[2].outerCutOff", glm::cos(glm::radians(40.0f)));
-
-        float near_plane = 1.0f;
-        float far_plane  = 10.0f;
-
-        if (SHADOW_FLAG) {
+    // the objects below delete GL objects when destroyed, the block ends while the context is still alive
+    {
+        // camera and lights live in std140 uniform buffers shared by the programs that declare the blocks
+        rg::UniformBuffer<rg::CameraUniforms> cameraUniforms(rg::CameraBinding);
+        rg::UniformBuffer<rg::LightUniforms> lightUniforms(rg::LightsBinding);
+        Shader occlusionShader("resources/shaders/occlusion_proxy.vs", "resources/shaders/occlusion_proxy.fs", nullptr, "",
+                               ShaderBuild::Deferred);
+        Shader::finishAll({&skyboxShader, &shadowShader, &shadowInstancedShader, &blurShader, &bloomShader, &occlusionShader});
+        skyboxShader.bindUniformBlock("Camera", rg::CameraBinding);
+        occlusionShader.bindUniformBlock("Camera", rg::CameraBinding);
+        const float near_plane = 1.0f;
+        const float far_plane  = 10.0f;
+        const float camera_near_plane = 0.1f;
+        const float camera_far_plane = 100.0f;
+        // constant plain uniforms are set once per variant, program objects keep them
+        lightingShaders.onCreate([far_plane](Shader &shader) {
+            shader.bindUniformBlock("Camera", rg::CameraBinding);
+            shader.bindUniformBlock("Lights", rg::LightsBinding);
+            shader.setFloat("material.shininess"_u, 32.0f);
+            shader.setInt("depthMap"_u, rg::kShadowMapUnit);
+            shader.setFloat("far_plane"_u, far_plane);
+        });
+        lightingShaders.finishPrepared();
+
+        // loading and framebuffer setup changed bindings behind the state cache's back
+        rg::GLState::invalidate();
+        rg::RenderQueue renderQueue;
+        SceneCulling sceneCulling;
+        rg::OcclusionQueries occlusionQueries;
+        rg::SoftwareOcclusion softwareOcclusion;
+        vector<std::pair<const rg::OccluderMesh*, glm::mat4>> occluderDraws;
+
+        // instanced renderables are drawn model by model next to the queue, one set per model, regrouped whenever the
+        // streaming adds or removes entities
+        vector<InstanceSet> instanceSets(models.size());
+        for (size_t i = 0; i < models.size(); i++)
+            instanceSets[i].model = &models[i];
+        bool regroupInstances = true;
+
+        // copies of the flower over the grass, as large as the scene's first flower; drawn while the flower is resident
+        InstanceSet flowerField;
+        rg::DepthPyramid depthPyramid;
+        uint32_t flowerModel = (uint32_t)models.size();
+        float flowerScale = 1.0f;
+        for (uint32_t i = 0; i < sceneDescription.models.size(); i++) {
+            if (sceneDescription.models[i].name == kFlowerFieldModel)
+                flowerModel = i;
+        }
+        for (const rg::SceneInstance &instance : sceneDescription.instances) {
+            if (instance.model == flowerModel) {
+                flowerScale = instance.scale.x;
+                break;
+            }
+        }
+
+        // render loop
+        // -----------
+        while (!glfwWindowShouldClose(window)) {
+            glm::mat4 model = glm::mat4(1.0f);
+
+            // per-frame time logic
+            // --------------------
+            float currentFrame = glfwGetTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+
+            // input
+            // -----
+            processInput(window);
+
+
+            // render
+            // ------
+            glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // world streaming, then what depends on the models it uploaded and released
+            streamer.update(programState->camera.Position, programState->streaming);
+            streamingStats = streamer.stats();
+            if (streamer.changed()) {
+                // the removed renderables were swapped out, their rows hold other objects now
+                regroupInstances = true;
+                occlusionQueries.reset();
+            }
+            for (uint32_t i = 0; i < models.size(); i++) {
+                bool resident = streamer.resident(i);
+                if (resident == (modelsReady[i] != 0))
+                    continue;
+                modelsReady[i] = resident;
+                if (resident) {
+                    models[i].SetShaderTextureNamePrefix("material.");
+                    if (occluderModels[i])
+                        occluders[i] = rg::selectOccluder(models[i].meshes, 2048);
+                } else {
+                    occluders[i] = rg::OccluderMesh();
+                    instanceSets[i].gpu.reset();
+                }
+                if (i == flowerModel) {
+                    flowerField.gpu.reset();
+                    flowerField.model = resident ? &models[i] : nullptr;
+                    flowerField.transforms = resident ? flowerFieldTransforms(flowerScale) : vector<glm::mat4>();
+                    if (resident)
+                        flowerField.upload();
+                }
+            }
+
+            // scene systems: world matrices of what moved, then what depends on them
+            rg::updateTransforms(scene.transforms);
+            rg::updateBounds(scene.bounds, scene);
+            if (!regroupInstances) {
+                for (InstanceSet &set : instanceSets) {
+                    if (!set.refresh(scene))
+                        regroupInstances = true;
+                }
+            }
+            if (regroupInstances) {
+                for (InstanceSet &set : instanceSets) {
+                    set.entities.clear();
+                    set.transforms.clear();
+                    set.castsShadow.clear();
+                }
+                for (size_t row = 0; row < scene.renderables.model.size(); row++) {
+                    if (!(scene.renderables.flags[row] & rg::kInstanced))
+                        continue;
+                    rg::Entity entity = scene.renderables.rows.entity((uint32_t)row);
+                    if (!rg::uniformlyScaled(scene.world(entity))) {
+                        // the instanced shaders use the transform as the normal matrix; drawn mesh by mesh from
+                        // now on, with the normal matrix of its transform
+                        scene.renderables.flags[row] &= (uint8_t)~rg::kInstanced;
+                        continue;
+                    }
+                    InstanceSet &set = instanceSets[scene.renderables.model[row]];
+                    set.entities.push_back(entity);
+                    set.transforms.push_back(scene.world(entity));
+                    set.castsShadow.push_back((scene.renderables.flags[row] & rg::kCastsShadow) ? 1 : 0);
+                }
+                for (InstanceSet &set : instanceSets) {
+                    if (set.transforms.empty())
+                        set.gpu.reset();
+                    else
+                        set.upload();
+                }
+                regroupInstances = false;
+            }
+
+            // the light set rarely changes, the buffer is only rewritten when it does
+            rg::LightUniforms lights = sceneLights(scene);
+            lightUniforms.update(lights);
+
+            // view/projection transformations, shared by every program through the Camera block
+            rg::CameraUniforms camera{};
+            camera.projection = glm::perspective(glm::radians(programState->camera.Zoom),
+                                                 (float) SCR_WIDTH / (float) SCR_HEIGHT, camera_near_plane, camera_far_plane);
+            camera.view = programState->camera.GetViewMatrix();
+            camera.viewPosition = programState->camera.Position;
+            cameraUniforms.update(camera);
+
+            // every draw of the frame goes into one queue, sorted once and executed pass by pass
+            uint32_t frameFeatures = rg::frameFeatures(SHADOW_FLAG, (rg::PcfQuality)programState->pcfQuality,
+                                                       programState->pointLightCount, programState->spotLightCount);
+            glm::mat4 viewProjection = camera.projection * camera.view;
+            occluderDraws.clear();
+            for (size_t row = 0; row < scene.renderables.model.size(); row++) {
+                if (scene.renderables.flags[row] & rg::kOccluder)
+                    occluderDraws.push_back({&occluders[scene.renderables.model[row]],
+                                             scene.world(scene.renderables.rows.entity((uint32_t)row))});
+            }
+            softwareOcclusion.rasterize(viewProjection, occluderDraws);
+            occlusionQueries.collect(scene.renderables.model.size());
+            // 0. create depth cube map transformation matrices of the shadow casting light, also what the scene culls
+            // the shadow pass against, face by face
+            // ------------------------------------------------
+            const int shadowLight = 1;
             glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), (float) SHADOW_WIDTH / (float) SHADOW_HEIGHT,
                                                     near_plane, far_plane);
+            const glm::vec3 lightPos = lights.pointLight[shadowLight].position;
             std::vector<glm::mat4> shadowTransforms;
-            for (int i = 1; i < 2; i++) {
-                // 0. create depth cube map transformation matrices
-                // ------------------------------------------------
-                shadowTransforms.clear();
-                shadowTransforms.push_back(shadowProj * glm::lookAt(programState->pointLightPositions[i],
-                                                                    programState->pointLightPositions[i] +
-                                                                    glm::vec3(1.0f, 0.0f, 0.0f),
-                                                                    glm::vec3(0.0f, -1.0f, 0.0f)));
-                shadowTransforms.push_back(shadowProj * glm::lookAt(programState->pointLightPositions[i],
-                                                                    programState->pointLightPositions[i] +
-                                                                    glm::vec3(-1.0f, 0.0f, 0.0f),
-                                                                    glm::vec3(0.0f, -1.0f, 0.0f)));
-                shadowTransforms.push_back(shadowProj * glm::lookAt(programState->pointLightPositions[i],
-                                                                    programState->pointLightPositions[i] +
-                                                                    glm::vec3(0.0f, 1.0f, 0.0f),
-                                                                    glm::vec3(0.0f, 0.0f, 1.0f)));
-                shadowTransforms.push_back(shadowProj * glm::lookAt(programState->pointLightPositions[i],
-                                                                    programState->pointLightPositions[i] +
-                                                                    glm::vec3(0.0f, -1.0f, 0.0f),
-                                                                    glm::vec3(0.0f, 0.0f, -1.0f)));
-                shadowTransforms.push_back(shadowProj * glm::lookAt(programState->pointLightPositions[i],
-                                                                    programState->pointLightPositions[i] +
-                                                                    glm::vec3(0.0f, 0.0f, 1.0f),
-                                                                    glm::vec3(0.0f, -1.0f, 0.0f)));
-                shadowTransforms.push_back(shadowProj * glm::lookAt(programState->pointLightPositions[i],
-                                                                    programState->pointLightPositions[i] +
-                                                                    glm::vec3(0.0f, 0.0f, -1.0f),
-                                                                    glm::vec3(0.0f, -1.0f, 0.0f)));
-
+            shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(1.0f, 0.0f, 0.0f),
+                                                                glm::vec3(0.0f, -1.0f, 0.0f)));
+            shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(-1.0f, 0.0f, 0.0f),
+                                                                glm::vec3(0.0f, -1.0f, 0.0f)));
+            shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, 1.0f, 0.0f),
+                                                                glm::vec3(0.0f, 0.0f, 1.0f)));
+            shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, -1.0f, 0.0f),
+                                                                glm::vec3(0.0f, 0.0f, -1.0f)));
+            shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, 0.0f, 1.0f),
+                                                                glm::vec3(0.0f, -1.0f, 0.0f)));
+            shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, 0.0f, -1.0f),
+                                                                glm::vec3(0.0f, -1.0f, 0.0f)));
+
+            rg::Frustum frustum = rg::Frustum::fromMatrix(viewProjection);
+            renderQueue.clear();
+            submitScene(renderQueue, sceneCulling, models, scene, SHADOW_FLAG ? &shadowShader : nullptr,
+                        lightPos, shadowTransforms.data(), far_plane, lightingShaders, frameFeatures, frustum,
+                        camera.viewPosition, camera_far_plane, occlusionQueries, softwareOcclusion);
+            renderQueue.sort();
+            countLitMeshes(sceneCulling, lights, programState->pointLightCount);
+
+            if (SHADOW_FLAG) {
                 // Render scene to depth cube map
                 // ---------------------------------
                 glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-                glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+                rg::GLState::bindFramebuffer(depthMapFBO);
                 glClear(GL_DEPTH_BUFFER_BIT);
                 shadowShader.use();
-                for (unsigned int i = 0; i < 6; ++i)
-                    shadowShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
-                shadowShader.setFloat("far_plane", far_plane);
-                shadowShader.setVec3("lightPos", programState->pointLightPositions[i]);
-                renderScene(shadowShader, models);
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                shadowShader.setMat4("shadowMatrices"_u, shadowTransforms.data(), 6);
+                shadowShader.setFloat("far_plane"_u, far_plane);
+                shadowShader.setVec3("lightPos"_u, lightPos);
+                renderQueue.execute(rg::RenderPass::Shadow);
+                shadowInstancedShader.use();
+                shadowInstancedShader.setMat4("shadowMatrices"_u, shadowTransforms.data(), 6);
+                shadowInstancedShader.setFloat("far_plane"_u, far_plane);
+                shadowInstancedShader.setVec3("lightPos"_u, lightPos);
+                for (InstanceSet &set : instanceSets)
+                    cullStats.sceneInstanceShadows += set.drawShadow(shadowInstancedShader, lightPos, far_plane);
+                rg::GLState::bindFramebuffer(0);
             }
-        }
 
-        ourShader.use();
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = programState->camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // set depthMaps
-        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        ourShader.use();
-        ourShader.setFloat("far_plane", far_plane);
-        ourShader.setInt("depthMap", 1);
-        ourShader.setBool("shadow_flag", SHADOW_FLAG);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-
-        // Render the loaded models //
-        renderScene(ourShader, models);
-
-        // Draw Skybox
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix()));
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
-
-        /* BLOOM AND HDR IMPLEMENTATION - NOT WORKING
-        // 2. blur bright fragments with two-pass Gaussian Blur
-        // --------------------------------------------------
-        bool horizontal = true, first_iteration = true;
-        unsigned int amount = 10;
-        blurShader.use();
-        for (unsigned int i = 0; i < amount; i++)
-        {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-            blurShader.setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
+            // set depthMaps
+            glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            rg::GLState::bindTexture(rg::kShadowMapUnit, GL_TEXTURE_CUBE_MAP, depthCubemap);
+
+            // Render the loaded models //
+            // opaque first, then the instanced copies, which are opaque too; blended surfaces go over all of them
+            renderQueue.execute(rg::RenderPass::Main, false);
+            cullStats.gpuCulling = rg::GpuCulling::supported();
+            bool anyInstances = false;
+            for (InstanceSet &set : instanceSets) {
+                if (set.transforms.empty())
+                    continue;
+                anyInstances = true;
+                cullStats.sceneInstances += set.transforms.size();
+                cullStats.sceneInstancesDrawn += set.draw(lightingShaders, frameFeatures, frustum, depthPyramid);
+            }
+            bool drawField = programState->flowerField && flowerField.model;
+            cullStats.fieldInstances = drawField ? flowerField.transforms.size() : 0;
+            if (drawField)
+                cullStats.fieldDrawn = flowerField.draw(lightingShaders, frameFeatures, frustum, depthPyramid);
+            // tested against this frame's depth, used by the next one
+            occlusionQueries.issue(occlusionShader, sceneCulling.modelBounds, sceneCulling.modelInView, camera.viewPosition,
+                                   camera_near_plane);
+            // depth of everything opaque, for the instance culling of the next frame
+            if (cullStats.gpuCulling && (drawField || anyInstances))
+                depthPyramid.build(SCR_WIDTH, SCR_HEIGHT, viewProjection);
+            else
+                depthPyramid.invalidate();
+            // back to front, after the depth copies above so nothing behind glass counts as hidden
+            renderQueue.execute(rg::RenderPass::Main, true);
+
+            // Draw Skybox
+            rg::GLState::depthFunc(GL_LEQUAL);
+            skyboxShader.use();
+
+            rg::GLState::bindVertexArray(skyboxVAO);
+            rg::GLState::bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            rg::GLState::depthFunc(GL_LESS);
+
+            /* BLOOM AND HDR IMPLEMENTATION - NOT WORKING
+            // 2. blur bright fragments with two-pass Gaussian Blur
+            // --------------------------------------------------
+            bool horizontal = true, first_iteration = true;
+            unsigned int amount = 10;
+            blurShader.use();
+            for (unsigned int i = 0; i < amount; i++)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
+                blurShader.setInt("horizontal"_u, horizontal);
+                glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
+                glBindVertexArray(quadVAO);
+                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                glBindVertexArray(0);
+                horizontal = !horizontal;
+                if (first_iteration)
+                    first_iteration = false;
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            // 3. now render floating point color buffer to 2D quad and tonemap HDR colors to default framebuffer's (clamped) color range
+            // --------------------------------------------------------------------------------------------------------------------------
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            bloomShader.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
+            bloomShader.setInt("bloom"_u, true);
+            bloomShader.setFloat("exposure"_u, exposure);
             glBindVertexArray(quadVAO);
             glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
             glBindVertexArray(0);
-            horizontal = !horizontal;
-            if (first_iteration)
-                first_iteration = false;
+            cout << "exposure: " << exposure << endl;
+             */
+
+            rg::GLState::endFrame();
+            if (programState->ImGuiEnabled)
+                DrawImGui(programState, scene);
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(window);
+            glfwPollEvents();
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        // 3. now render floating point color buffer to 2D quad and tonemap HDR colors to default framebuffer's (clamped) color range
-        // --------------------------------------------------------------------------------------------------------------------------
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        bloomShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-        bloomShader.setInt("bloom", true);
-        bloomShader.setFloat("exposure", exposure);
-        glBindVertexArray(quadVAO);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
-        cout << "exposure: " << exposure << endl;
-         */
-
-        if (programState->ImGuiEnabled)
-            DrawImGui(programState);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
     }
 
     programState->SaveToFile("resources/program_state.txt");
@@ -665,97 +915,193 @@ int main() {
     return 0;
 }
 
-unsigned int loadCubemap(vector<std::string> faces)
+// precompressed cubemap when there is a usable one, otherwise the decoded faces; 0 if the precompressed file
+// failed and no faces were decoded
+unsigned int loadCubemap(const std::string &precompressed, vector<std::future<rg::CubemapFace>> &faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    if (!precompressed.empty()) {
+        unsigned int textureID = rg::loadKtxCubemap(precompressed);
+        if (textureID || faces.empty())
+            return textureID;
+    }
+    return rg::createCubemap(faces);
+}
 
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                         0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
-            stbi_image_free(data);
+// every light entity fills its slot of the light arrays, a point light and a spot light at its world position
+rg::LightUniforms sceneLights(const rg::Scene &scene) {
+    rg::LightUniforms lights{};
+    const rg::LightComponents &sources = scene.lights;
+    for (size_t row = 0; row < sources.slot.size(); row++) {
+        int slot = sources.slot[row];
+        if (slot < 0 || slot >= rg::kNumLights)
+            continue;
+        glm::vec3 position(scene.world(sources.rows.entity((uint32_t)row))[3]);
+        const rg::LightColor &point = sources.point[row];
+        const rg::LightColor &spot = sources.spot[row];
+        lights.pointLight[slot] = rg::makePointLight(position, point.ambient, point.diffuse, point.specular,
+                                                     point.attenuation.x, point.attenuation.y, point.attenuation.z);
+        lights.spotLight[slot] = rg::makeSpotLight(position, sources.spotDirection[row], spot.ambient, spot.diffuse,
+                                                   spot.specular, spot.attenuation.x, spot.attenuation.y,
+                                                   spot.attenuation.z, glm::cos(glm::radians(sources.spotCutOff[row].x)),
+                                                   glm::cos(glm::radians(sources.spotCutOff[row].y)));
+    }
+    return lights;
+}
+
+// model matrices of the flower field, a jittered 64x64 grid over the grass
+vector<glm::mat4> flowerFieldTransforms(float flowerScale) {
+    vector<glm::mat4> transforms;
+    const int side = 64;
+    const float spacing = 0.5f;
+    uint32_t seed = 12345u;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u; // LCG, the field looks the same on every run
+        return (float)(seed >> 8) / (float)(1u << 24);
+    };
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            glm::vec3 position((x - side / 2 + random()) * spacing, 0.0f, (z - side / 2 + random()) * spacing);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+            model = glm::rotate(model, random() * glm::radians(360.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            model = glm::scale(model, glm::vec3(flowerScale * (0.5f + 0.5f * random())));
+            transforms.push_back(model);
         }
-        else
-        {
-            std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
+    }
+    return transforms;
+}
+
+// queues every mesh of the scene's renderables that can be seen, found through the scene BVH: for the shadow pass when
+// there is a shadow program (meshes of shadow casters whose box reaches into the light's range, depth measured from
+// the light) and for the main pass when its box is inside the view frustum and its renderable was not found hidden by
+// last frame's occlusion queries, with the lighting variant its material needs (depth measured from the camera).
+// Meshes in view also have to get past the CPU occlusion pass, rasterized by the caller while the frustum tests run.
+// Hidden renderables still cast shadows. Meshes split into
+// meshlets only submit the clusters that are in view and not facing away, against the camera for the main pass and
+// against the light and the six cube faces for the shadow pass.
+void submitScene(rg::RenderQueue &queue, SceneCulling &culling, vector<Model> &models, const rg::Scene &scene,
+                 Shader *shadowShader, const glm::vec3 &lightPosition, const glm::mat4 *shadowFaces, float shadowRange,
+                 rg::ShaderPermutations &variants, uint32_t frameFeatures, const rg::Frustum &frustum,
+                 const glm::vec3 &viewPosition, float viewRange, const rg::OcclusionQueries &occlusion,
+                 rg::SoftwareOcclusion &softwareOcclusion) {
+    // world bounds of every mesh in scene order, which is also the item numbering of the BVH. Moving objects
+    // only refit it, it is rebuilt when meshes come or go.
+    culling.meshes.clear();
+    culling.normalMatrices.clear();
+    culling.bounds.clear();
+    culling.owners.clear();
+    const rg::RenderableComponents &renderables = scene.renderables;
+    culling.modelBounds.assign(renderables.model.size(), rg::Aabb());
+    for (uint32_t object = 0; object < renderables.model.size(); object++) {
+        if (renderables.flags[object] & rg::kInstanced)
+            continue; // drawn with its instance set
+        rg::Entity entity = renderables.rows.entity(object);
+        const glm::mat4 &world = scene.world(entity);
+        const glm::mat3 &normalMatrix = scene.normalMatrix(entity);
+        for (Mesh &mesh : models[renderables.model[object]].meshes) {
+            culling.meshes.push_back({&mesh, &world});
+            culling.normalMatrices.push_back(&normalMatrix);
+            culling.bounds.push_back(rg::transformAabb(mesh.bounds, world));
+            culling.owners.push_back(object);
         }
+        uint32_t boundsRow = scene.bounds.rows.row(entity);
+        if (boundsRow != rg::kNoRow)
+            culling.modelBounds[object] = scene.bounds.world[boundsRow];
+    }
+    culling.bvh.refit(culling.bounds);
+
+    // leaves entirely in view are accepted as they are, the items of the others go through the SIMD test
+    culling.visible.assign(culling.meshes.size(), 0);
+    culling.candidates.clear();
+    culling.culler.clear();
+    culling.bvh.queryFrustum(frustum, [&culling](uint32_t item, bool inside) {
+        if (inside) {
+            culling.visible[item] = 1;
+            return;
+        }
+        culling.candidates.push_back(item);
+        culling.culler.add(culling.bounds[item]);
+    });
+    culling.culler.cull(frustum);
+    for (size_t k = 0; k < culling.candidates.size(); k++) {
+        if (culling.culler.visible(k))
+            culling.visible[culling.candidates[k]] = 1;
+    }
+    size_t softwareOccluded = softwareOcclusion.test(culling.bounds, culling.visible);
+    culling.modelInView.assign(renderables.model.size(), 0);
+    for (size_t item = 0; item < culling.meshes.size(); item++)
+        culling.modelInView[culling.owners[item]] |= culling.visible[item];
+
+    cullStats = CullStats();
+    cullStats.softwareOccluded = softwareOccluded;
+    cullStats.occluderTriangles = softwareOcclusion.trianglesDrawn();
+    cullStats.occluderMilliseconds = softwareOcclusion.rasterMilliseconds();
+
+    // one packet for a whole mesh, one per run of kept clusters for a mesh split into meshlets
+    auto submitMesh = [&](uint64_t key, Shader *program, size_t item, const rg::Frustum *frustums, int frustumCount,
+                          const glm::vec3 &eye, size_t &drawn, size_t &dropped) {
+        Mesh &mesh = *culling.meshes[item].first;
+        const glm::mat4 *transform = culling.meshes[item].second;
+        const glm::mat3 *normalMatrix = culling.normalMatrices[item];
+        if (mesh.meshlets.empty()) {
+            queue.submit({key, program, &mesh, transform, normalMatrix, 0, (uint32_t)mesh.indexCount});
+            return;
+        }
+        culling.ranges.clear();
+        size_t kept = rg::cullMeshlets(mesh.meshlets, *transform, frustums, frustumCount, eye, culling.ranges);
+        drawn += kept;
+        dropped += mesh.meshlets.size() - kept;
+        for (const rg::IndexRange &range : culling.ranges)
+            queue.submit({key, program, &mesh, transform, normalMatrix, range.first, range.count});
+    };
+
+    if (shadowShader) {
+        // the geometry shader draws every cube face in one go, so a cluster stays if any face sees it
+        rg::Frustum shadowFrusta[6];
+        for (int face = 0; face < 6; face++)
+            shadowFrusta[face] = rg::Frustum::fromMatrix(shadowFaces[face]);
+        culling.bvh.querySphere(lightPosition, shadowRange, [&](uint32_t item) {
+            if (!(renderables.flags[culling.owners[item]] & rg::kCastsShadow))
+                return;
+            const rg::Aabb &box = culling.bounds[item];
+            glm::vec3 center = box.empty() ? glm::vec3((*culling.meshes[item].second)[3]) : box.center();
+            uint32_t lightDepth = rg::quantizeDepth(glm::length(center - lightPosition), shadowRange);
+            submitMesh(rg::sortKey(rg::RenderPass::Shadow, false, shadowShader->ID, 0, lightDepth), shadowShader,
+                       item, shadowFrusta, 6, lightPosition, cullStats.shadowMeshletsDrawn,
+                       cullStats.shadowMeshletsCulled);
+            ++cullStats.shadowCasters;
+        });
+        cullStats.shadowCulled = culling.meshes.size() - cullStats.shadowCasters;
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    return textureID;
+    for (size_t item = 0; item < culling.meshes.size(); item++) {
+        if (!culling.visible[item]) {
+            ++cullStats.culled;
+            continue;
+        }
+        if (!occlusion.visible(culling.owners[item])) {
+            ++cullStats.occluded;
+            continue;
+        }
+        ++cullStats.visible;
+        Mesh &mesh = *culling.meshes[item].first;
+        const rg::Aabb &box = culling.bounds[item];
+        glm::vec3 center = box.empty() ? glm::vec3((*culling.meshes[item].second)[3]) : box.center();
+        uint32_t viewDepth = rg::quantizeDepth(glm::length(center - viewPosition), viewRange);
+        Shader &variant = variants.get(frameFeatures | mesh.MaterialFeatures());
+        submitMesh(rg::sortKey(rg::RenderPass::Main, mesh.transparent, variant.ID, mesh.MaterialId(), viewDepth),
+                   &variant, item, &frustum, 1, viewPosition, cullStats.meshletsDrawn, cullStats.meshletsCulled);
+    }
+    cullStats.culled -= softwareOccluded; // counted above with the frustum culled ones
 }
 
-void renderScene(Shader &shader, vector<Model> &models) {
-    // Render the loaded models //
-    glm::mat4 model = glm::mat4(1.0f);
-
-    // Grass model
-    model = glm::mat4(1.0f);
-    model = glm::scale(model, glm::vec3(programState->grassScale));
-    model = glm::rotate(model, glm::radians(90.f), glm::vec3(-1.0, 0.0, 0.0));
-    shader.setMat4("model", model);
-    models[0].Draw(shader);
-
-    // Car model
-    model = glm::mat4(1.0f);
-    model = glm::scale(model, glm::vec3(programState->carScale));
-    model = glm::translate(model, programState->carPosition);
-    shader.setMat4("model", model);
-    models[1].Draw(shader);
-
-    // Lamp model
-    model = glm::mat4(1.0f);
-    model = glm::scale(model, glm::vec3(programState->lampScale));
-    model = glm::translate(model, programState->lampPosition);
-    shader.setMat4("model", model);
-    models[2].Draw(shader);
-
-    // Lamp2 model
-    model = glm::mat4(1.0f);
-    model = glm::scale(model, glm::vec3(programState->lamp2Scale));
-    model = glm::translate(model, programState->lamp2Position);
-    shader.setMat4("model", model);
-    models[3].Draw(shader);
-
-    // Cat model
-    model = glm::mat4(1.0f);
-    model = glm::scale(model, glm::vec3(programState->catScale));
-    model = glm::translate(model, programState->catPosition);
-    shader.setMat4("model", model);
-    models[4].Draw(shader);
-
-    // Table model
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, programState->tablePosition);
-    model = glm::scale(model, glm::vec3(programState->tableScale));
-    shader.setMat4("model", model);
-    models[5].Draw(shader);
-
-    // Flower model
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, programState->flowerPosition);
-    model = glm::scale(model, glm::vec3(programState->flowerScale));
-    shader.setMat4("model", model);
-    models[6].Draw(shader);
-
-    // Tree model
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, programState->treePosition);
-    model = glm::scale(model, glm::vec3(programState->treeScale));
-    shader.setMat4("model", model);
-    models[7].Draw(shader);
+// meshes within reach of each enabled point light, for the debug window
+void countLitMeshes(const SceneCulling &culling, const rg::LightUniforms &lights, int pointLights) {
+    for (int i = 0; i < rg::kNumLights; i++) {
+        cullStats.litMeshes[i] = 0;
+        if (i < pointLights)
+            culling.bvh.querySphere(lights.pointLight[i].position, rg::lightRange(lights.pointLight[i]),
+                                    [i](uint32_t) { ++cullStats.litMeshes[i]; });
+    }
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -823,7 +1169,7 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     programState->camera.ProcessMouseScroll(yoffset);
 }
 
-void DrawImGui(ProgramState *programState) {
+void DrawImGui(ProgramState *programState, rg::Scene &scene) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -836,7 +1182,12 @@ void DrawImGui(ProgramState *programState) {
         ImGui::SliderFloat("Float slider", &f, 0.0, 1.0);
         ImGui::ColorEdit3("Background color", (float *) &programState->clearColor);
 
-        ImGui::DragFloat3("lightParams[1].position", (float*)&programState->pointLightPositions[2]);
+        for (size_t row = 0; row < scene.lights.slot.size(); row++) {
+            uint32_t transform = scene.transforms.rows.row(scene.lights.rows.entity((uint32_t)row));
+            if (scene.lights.slot[row] == 2 && transform != rg::kNoRow &&
+                ImGui::DragFloat3("lightParams[1].position", (float*)&scene.transforms.position[transform]))
+                scene.transforms.dirty[transform] = 1;
+        }
 
         ImGui::DragFloat3("lightParams[1].ambient_plight", (float*)&programState->ambient_plight);
         ImGui::DragFloat3("lightParams[1].diffuse_plight", (float*)&programState->diffuse_plight);
@@ -856,6 +1207,50 @@ void DrawImGui(ProgramState *programState) {
         ImGui::DragFloat("lightParams[1].cutOff_slight", &programState->cutOff_slight, 0.05, 0.0, 360.0);
         ImGui::DragFloat("lightParams[1].outerCutOff_slight", &programState->outerCutOff_slight, 0.05, 0.0, 360.0);
 
+        ImGui::Combo("Shadow PCF quality", &programState->pcfQuality, "Low\0Medium\0High\0");
+        ImGui::SliderInt("Point lights", &programState->pointLightCount, 0, rg::kNumLights);
+        ImGui::SliderInt("Spot lights", &programState->spotLightCount, 0, rg::kNumLights);
+        ImGui::Text("Redundant GL calls skipped: %u", rg::GLState::eliminatedCalls());
+        ImGui::Text("Entities: %zu, drawn: %zu, lights: %zu", scene.size(), scene.renderables.model.size(),
+                    scene.lights.slot.size());
+        ImGui::Text("Meshes visible: %zu, culled: %zu", cullStats.visible, cullStats.culled);
+        ImGui::Text("Meshes occluded: %zu (GPU queries), %zu (CPU raster)", cullStats.occluded,
+                    cullStats.softwareOccluded);
+        ImGui::Text("CPU occluders: %zu triangles in %.2f ms", cullStats.occluderTriangles,
+                    cullStats.occluderMilliseconds);
+        ImGui::Text("Shadow casters: %zu, culled: %zu", cullStats.shadowCasters, cullStats.shadowCulled);
+        ImGui::Text("Meshlets drawn: %zu, culled: %zu (shadow: %zu, %zu)", cullStats.meshletsDrawn,
+                    cullStats.meshletsCulled, cullStats.shadowMeshletsDrawn, cullStats.shadowMeshletsCulled);
+        ImGui::Text("Meshes lit by point lights: %zu / %zu / %zu", cullStats.litMeshes[0], cullStats.litMeshes[1],
+                    cullStats.litMeshes[2]);
+        ImGui::Checkbox("Flower field", &programState->flowerField);
+        if (cullStats.gpuCulling)
+            ImGui::Text("Flower field: %zu instances, culled on the GPU", cullStats.fieldInstances);
+        else
+            ImGui::Text("Flower field: %zu instances, %zu drawn after CPU culling", cullStats.fieldInstances,
+                        cullStats.fieldDrawn);
+        ImGui::Text("Instanced scene objects: %zu, %zu drawn, %zu casting shadows", cullStats.sceneInstances,
+                    cullStats.sceneInstancesDrawn, cullStats.sceneInstanceShadows);
+
+        rg::StreamingSettings &streaming = programState->streaming;
+        ImGui::DragFloat("Streaming load radius", &streaming.loadRadius, 0.5f, 0.0f, 1000.0f);
+        ImGui::DragFloat("Streaming unload margin", &streaming.unloadMargin, 0.5f, 0.0f, 100.0f);
+        int memoryBudget = (int)(streaming.memoryBudget >> 20), uploadLimit = (int)(streaming.uploadBytesPerFrame >> 20);
+        int instanceLimit = (int)streaming.instancesPerFrame;
+        if (ImGui::DragInt("Streaming memory budget (MB)", &memoryBudget, 8.0f, 16, 16384))
+            streaming.memoryBudget = (size_t)memoryBudget << 20;
+        if (ImGui::DragInt("Streaming uploads per frame (MB)", &uploadLimit, 1.0f, 1, 1024))
+            streaming.uploadBytesPerFrame = (size_t)uploadLimit << 20;
+        if (ImGui::DragInt("Streaming entities per frame", &instanceLimit, 16.0f, 1, 1 << 20))
+            streaming.instancesPerFrame = (size_t)instanceLimit;
+        ImGui::Text("Cells: %zu resident, %zu loading of %zu", streamingStats.residentCells,
+                    streamingStats.loadingCells, streamingStats.cells);
+        ImGui::Text("Models: %zu resident, %zu decoding, %.1f MB", streamingStats.residentModels,
+                    streamingStats.decodingModels, streamingStats.residentBytes / (1024.0 * 1024.0));
+        ImGui::Text("Streamed this frame: %.1f MB uploaded, %zu entities created, %zu destroyed",
+                    streamingStats.uploadedBytes / (1024.0 * 1024.0), streamingStats.createdEntities,
+                    streamingStats.destroyedEntities);
+
         ImGui::End();
     }
 
@@ -0,0 +1,66 @@
+// Builds the resource pack the application mounts at startup.
+//
+//   resource_pack <output.pack> <file or directory>...
+//
+// Paths are stored as given, relative to the working directory, so run it from the project root:
+//   ./resource_pack resources.pack resources/shaders resources/objects
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <rg/Resources.h>
+
+static void collectFiles(const std::string& path, std::vector<std::pair<std::string, std::string>>& files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        std::cerr << "skipping missing path " << path << std::endl;
+        return;
+    }
+    if (S_ISREG(st.st_mode)) {
+        files.emplace_back(path, path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+        return;
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+        return;
+    std::vector<std::string> children;
+    while (dirent* entry = readdir(dir)) {
+        // also skips editor folders such as .mayaSwatches
+        if (entry->d_name[0] != '.')
+            children.push_back(path + "/" + entry->d_name);
+    }
+    closedir(dir);
+    // deterministic packs for identical inputs
+    std::sort(children.begin(), children.end());
+    for (const std::string& child : children)
+        collectFiles(child, files);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <output.pack> <file or directory>..." << std::endl;
+        return 1;
+    }
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 2; i < argc; ++i)
+        collectFiles(argv[i], files);
+
+    std::string error;
+    if (!rg::ResourcePack::write(argv[1], files, &error)) {
+        std::cerr << "ERROR::RESOURCE_PACK:: " << error << std::endl;
+        return 1;
+    }
+    rg::ResourcePack pack;
+    if (!pack.open(argv[1])) {
+        std::cerr << "ERROR::RESOURCE_PACK:: written pack does not open" << std::endl;
+        return 1;
+    }
+    std::cout << "packed " << pack.entryCount() << " files into " << argv[1] << std::endl;
+    return 0;
+}
@@ -0,0 +1,36 @@
+// Converts scene files between the text and the binary form (see rg::SceneFile).
+//
+//   scene_convert <input> <output>
+//
+// The input may be either form; the output is binary when its name ends in .sceneb and text otherwise. The
+// application loads resources/scenes/garden.sceneb when it exists and garden.scene otherwise, so converting
+// the text scene is all it takes to switch:
+//   ./scene_convert resources/scenes/garden.scene resources/scenes/garden.sceneb
+
+#include <iostream>
+#include <string>
+#include <rg/SceneFile.h>
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <input> <output>" << std::endl;
+        return 1;
+    }
+    rg::SceneDescription scene;
+    std::string error;
+    if (!rg::SceneFile::load(argv[1], scene, &error)) {
+        std::cerr << "ERROR::SCENE:: " << error << std::endl;
+        return 1;
+    }
+    std::string output = argv[2];
+    bool binary = output.size() > 7 && output.compare(output.size() - 7, 7, ".sceneb") == 0;
+    bool written = binary ? rg::SceneFile::writeBinary(output, scene, &error)
+                          : rg::SceneFile::writeText(output, scene, &error);
+    if (!written) {
+        std::cerr << "ERROR::SCENE:: " << error << std::endl;
+        return 1;
+    }
+    std::cout << "wrote " << scene.models.size() << " models, " << scene.instances.size() << " instances and "
+              << scene.lights.size() << " lights to " << output << std::endl;
+    return 0;
+}